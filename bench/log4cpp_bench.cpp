@@ -0,0 +1,305 @@
+#include "log.hpp"
+#include "async.hpp"
+#include "binary.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <fcntl.h>
+#include <unistd.h>
+
+/**
+ * 性能基准: 每个场景分别在 1, 2, 4 ... N 个线程下运行(N 为 --threads, 默认硬件并发数)
+ *  - 延迟: 每次调用单独计时, 输出 p50/p99/p99.9/max(含一次 steady_clock::now 的开销)
+ *  - 吞吐: 不计时地连续调用, 按总调用数/墙钟时间计算
+ * 结果以 JSON 输出到标准输出或 --output 指定的文件.
+ *
+ * 用法: log4cpp_bench [--iterations N] [--threads N] [--filter substr] [--output file]
+ *                     [--clock system|coarse|tsc]
+ */
+
+using namespace log4cpp;
+using Clock = std::chrono::steady_clock;
+
+namespace {
+
+struct Config{
+    uint64_t iterations = 100000;           // 每个线程的调用次数
+    unsigned threads = 0;                   // 最大线程数, 0 表示硬件并发数
+    std::string filter;                     // 只运行名称包含该子串的场景
+    std::string output;                     // 结果文件, 空表示标准输出
+    std::string clock = "system";           // 日志时间源
+};
+
+struct Result{
+    std::string scenario;
+    unsigned threads;
+    uint64_t iterations;
+    uint64_t p50, p99, p999, max;
+    double mean;
+    double throughput;
+};
+
+// 一个场景: 日志器与其输出器的组合, 加上一条日志语句
+template <typename F>
+void Measure(const Config& config, std::vector<Result>& results, const std::string& name,
+        Logger::ptr logger, LogAppender::ptr appender, F call)
+{
+    if(!config.filter.empty() && name.find(config.filter) == std::string::npos){
+        return;
+    }
+    Logger* raw = logger.get();
+    std::vector<unsigned> thread_counts;
+    for(unsigned threads=1; threads<config.threads; threads*=2){
+        thread_counts.push_back(threads);
+    }
+    thread_counts.push_back(config.threads);
+    for(unsigned threads : thread_counts){
+        // 预热
+        for(uint64_t i=0; i<config.iterations / 10; ++i){
+            call(raw, i);
+        }
+        if(appender){
+            appender->flush();
+        }
+
+        std::vector<std::vector<uint32_t>> samples(threads);
+        std::vector<std::thread> workers;
+        for(unsigned t=0; t<threads; ++t){
+            workers.emplace_back([&, t]{
+                auto& s = samples[t];
+                s.resize(config.iterations);
+                for(uint64_t i=0; i<config.iterations; ++i){
+                    auto begin = Clock::now();
+                    call(raw, i);
+                    auto end = Clock::now();
+                    s[i] = static_cast<uint32_t>(std::min<int64_t>(
+                            std::chrono::duration_cast<std::chrono::nanoseconds>(end - begin).count(), UINT32_MAX));
+                }
+            });
+        }
+        for(auto& w : workers){
+            w.join();
+        }
+        workers.clear();
+        if(appender){
+            appender->flush();
+        }
+
+        auto begin = Clock::now();
+        for(unsigned t=0; t<threads; ++t){
+            workers.emplace_back([&]{
+                for(uint64_t i=0; i<config.iterations; ++i){
+                    call(raw, i);
+                }
+            });
+        }
+        for(auto& w : workers){
+            w.join();
+        }
+        if(appender){
+            appender->flush();
+        }
+        double seconds = std::chrono::duration<double>(Clock::now() - begin).count();
+
+        std::vector<uint32_t> all;
+        all.reserve(config.iterations * threads);
+        for(auto& s : samples){
+            all.insert(all.end(), s.begin(), s.end());
+        }
+        std::sort(all.begin(), all.end());
+        auto at = [&all](double q){
+            return static_cast<uint64_t>(all[std::min(all.size() - 1, static_cast<size_t>(q * all.size()))]);
+        };
+        double sum = 0;
+        for(auto v : all){
+            sum += v;
+        }
+        results.push_back({name, threads, config.iterations,
+                at(0.5), at(0.99), at(0.999), all.back(),
+                all.empty() ? 0 : sum / all.size(),
+                seconds > 0 ? config.iterations * threads / seconds : 0});
+        std::fprintf(stderr, "%-28s threads=%-3u p50=%lluns p99=%lluns max=%lluns %.0f/s\n",
+                name.c_str(), threads,
+                static_cast<unsigned long long>(results.back().p50),
+                static_cast<unsigned long long>(results.back().p99),
+                static_cast<unsigned long long>(results.back().max),
+                results.back().throughput);
+    }
+}
+
+Logger::ptr MakeLogger(const std::string& name, LogAppender::ptr appender, const std::string& pattern = "")
+{
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, name);
+    if(!pattern.empty()){
+        appender->setFormatter(std::make_shared<LogFormatter>(pattern));
+    }
+    logger->addAppender(appender);
+    return logger;
+}
+
+void WriteJson(std::FILE* out, const Config& config, const std::vector<Result>& results)
+{
+    std::fprintf(out, "{\n");
+    std::fprintf(out, "  \"version\": \"%s\",\n", LOG4CPP_VERSION);
+    std::fprintf(out, "  \"hardware_concurrency\": %u,\n", std::thread::hardware_concurrency());
+    std::fprintf(out, "  \"clock\": \"%s\",\n", config.clock.c_str());
+    std::fprintf(out, "  \"iterations_per_thread\": %llu,\n", static_cast<unsigned long long>(config.iterations));
+    std::fprintf(out, "  \"results\": [\n");
+    for(size_t i=0; i<results.size(); ++i){
+        const Result& r = results[i];
+        std::fprintf(out, "    {\"scenario\": \"%s\", \"threads\": %u, \"iterations\": %llu, "
+                "\"latency_ns\": {\"p50\": %llu, \"p99\": %llu, \"p999\": %llu, \"max\": %llu, \"mean\": %.1f}, "
+                "\"throughput_per_sec\": %.0f}%s\n",
+                r.scenario.c_str(), r.threads, static_cast<unsigned long long>(r.iterations),
+                static_cast<unsigned long long>(r.p50), static_cast<unsigned long long>(r.p99),
+                static_cast<unsigned long long>(r.p999), static_cast<unsigned long long>(r.max),
+                r.mean, r.throughput, i + 1 < results.size() ? "," : "");
+    }
+    std::fprintf(out, "  ]\n}\n");
+}
+
+bool ParseArgs(int argc, char** argv, Config& config)
+{
+    for(int i=1; i<argc; ++i){
+        std::string arg = argv[i];
+        if(i + 1 >= argc){
+            return false;
+        }
+        if(arg == "--iterations"){
+            config.iterations = std::strtoull(argv[++i], nullptr, 10);
+        }
+        else if(arg == "--threads"){
+            config.threads = static_cast<unsigned>(std::strtoul(argv[++i], nullptr, 10));
+        }
+        else if(arg == "--filter"){
+            config.filter = argv[++i];
+        }
+        else if(arg == "--output"){
+            config.output = argv[++i];
+        }
+        else if(arg == "--clock"){
+            config.clock = argv[++i];
+        }
+        else{
+            return false;
+        }
+    }
+    return config.iterations > 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv){
+    Config config;
+    if(!ParseArgs(argc, argv, config)){
+        std::fprintf(stderr, "usage: %s [--iterations N] [--threads N] [--filter substr] [--output file]"
+                " [--clock system|coarse|tsc]\n", argv[0]);
+        return 2;
+    }
+    const std::pair<const char*, LogClock::Source> clocks[] = {
+        {"system", LogClock::Source::system},
+        {"coarse", LogClock::Source::coarse},
+        {"tsc", LogClock::Source::tsc},
+    };
+    auto clock = std::find_if(std::begin(clocks), std::end(clocks),
+            [&config](auto& c){ return config.clock == c.first; });
+    if(clock == std::end(clocks) || !LogClock::SetSource(clock->second)){
+        std::fprintf(stderr, "clock source %s is not available\n", config.clock.c_str());
+        return 2;
+    }
+    if(config.threads == 0){
+        config.threads = std::max(1u, std::thread::hardware_concurrency());
+    }
+
+    // 标准输出场景写到 /dev/null, 结果在恢复标准输出后再写出
+    std::fflush(stdout);
+    int saved_stdout = ::dup(STDOUT_FILENO);
+    int devnull = ::open("/dev/null", O_WRONLY);
+    ::dup2(devnull, STDOUT_FILENO);
+    ::close(devnull);
+
+    std::vector<Result> results;
+    const std::string kDefault = "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+    {
+        auto appender = std::make_shared<FileLogAppender>("/dev/null");
+        auto logger = MakeLogger("disabled", appender);
+        logger->setLevel(LogLevel::Level::error);
+        Measure(config, results, "disabled_level", logger, nullptr, [](Logger* l, uint64_t i){
+            LOG_DEBUG(l) << "disabled " << i;
+        });
+    }
+    {
+        auto appender = std::make_shared<StdoutLogAppender>();
+        auto logger = MakeLogger("stdout", appender);
+        Measure(config, results, "stdout_devnull", logger, appender, [](Logger* l, uint64_t i){
+            LOG_INFO(l) << "stdout line " << i << " value " << 3.25;
+        });
+    }
+    {
+        std::string path = "log4cpp_bench_" + std::to_string(::getpid()) + ".log";
+        auto appender = std::make_shared<FileLogAppender>(path);
+        auto logger = MakeLogger("file", appender);
+        Measure(config, results, "file", logger, appender, [](Logger* l, uint64_t i){
+            LOG_INFO(l) << "file line " << i << " value " << 3.25;
+        });
+        ::unlink(path.c_str());
+    }
+    {
+        auto appender = std::make_shared<AsyncLogAppender>(std::make_shared<FileLogAppender>("/dev/null"));
+        auto logger = MakeLogger("async", appender);
+        Measure(config, results, "async_file_devnull", logger, appender, [](Logger* l, uint64_t i){
+            LOG_INFO(l) << "async line " << i << " value " << 3.25;
+        });
+    }
+    const std::pair<const char*, std::string> patterns[] = {
+        {"pattern_message", "%m%n"},
+        {"pattern_default", kDefault},
+        {"pattern_iso8601", "%d{ISO8601} [%p] [%c] %f:%l %m%n"},
+        {"pattern_subsecond", "%d{%H:%M:%S.%us} %t %N [%p] %m%n"},
+    };
+    for(auto& [name, pattern] : patterns){
+        auto appender = std::make_shared<FileLogAppender>("/dev/null");
+        auto logger = MakeLogger(name, appender, pattern);
+        Measure(config, results, name, logger, appender, [](Logger* l, uint64_t i){
+            LOG_INFO(l) << "pattern line " << i;
+        });
+    }
+    {
+        auto appender = std::make_shared<FileLogAppender>("/dev/null");
+        auto logger = MakeLogger("macros", appender, "%m%n");
+        Measure(config, results, "macro_LOG", logger, appender, [](Logger* l, uint64_t i){
+            LOG_INFO(l) << "request " << i << " took " << 12.5 << "ms from " << "client";
+        });
+        Measure(config, results, "macro_LOG_FMT", logger, appender, [](Logger* l, uint64_t i){
+            LOG_FMT(l, "info", "request %llu took %gms from %s", static_cast<unsigned long long>(i), 12.5, "client");
+        });
+        Measure(config, results, "macro_LOG4CPP_INFO", logger, appender, [](Logger* l, uint64_t i){
+            LOG4CPP_INFO(l, "request {} took {}ms from {}", i, 12.5, "client");
+        });
+    }
+    {
+        auto appender = std::make_shared<BinaryLogAppender>("/dev/null");
+        auto logger = MakeLogger("binary", appender);
+        Measure(config, results, "macro_LOG4CPP_BIN_INFO", logger, appender, [](Logger* l, uint64_t i){
+            LOG4CPP_BIN_INFO(l, "request {} took {}ms from {}", i, 12.5, "client");
+        });
+    }
+
+    ::dup2(saved_stdout, STDOUT_FILENO);
+    ::close(saved_stdout);
+
+    std::FILE* out = stdout;
+    if(!config.output.empty()){
+        out = std::fopen(config.output.c_str(), "w");
+        if(!out){
+            std::fprintf(stderr, "cannot open %s\n", config.output.c_str());
+            return 1;
+        }
+    }
+    WriteJson(out, config, results);
+    if(out != stdout){
+        std::fclose(out);
+    }
+    return 0;
+}
@@ -0,0 +1,90 @@
+#ifndef __ASYNC_HPP__
+#define __ASYNC_HPP__
+
+#include "log.hpp"
+
+#include <atomic>
+#include <condition_variable>
+
+namespace log4cpp {
+
+class RingQueue;
+
+/**
+ * @brief 异步日志输出器(装饰器)
+ * @details
+ *  调用线程只把事件压入有界无锁环形队列, 由后台线程取出后交给被装饰的输出器.
+ *  生产者线程按线程序号散列到各个队列, 后台线程 w 负责序号 i % workers == w 的队列.
+ *  队列满时按 OverflowPolicy 处理:
+ *   block        等待队列腾出空间
+ *   drop_newest  丢弃当前事件
+ *   drop_oldest  丢弃队列中最旧的事件
+ *  丢弃的事件计入 getDropped().
+ */
+class AsyncLogAppender : public LogAppender{
+public:
+    using ptr = std::shared_ptr<AsyncLogAppender>;
+
+    enum class OverflowPolicy{
+        block = 0,
+        drop_newest = 1,
+        drop_oldest = 2
+    };
+
+    struct Options{
+        size_t capacity = 8192;                         // 每个队列容量(向上取2的幂)
+        size_t queues = 4;                              // 队列个数
+        size_t workers = 1;                             // 后台线程数
+        OverflowPolicy policy = OverflowPolicy::block;  // 队列满时的策略
+    };
+
+    AsyncLogAppender(LogAppender::ptr appender);
+    AsyncLogAppender(LogAppender::ptr appender, const Options& options);
+    ~AsyncLogAppender();
+
+    void log(LogEvent::ptr event) override;
+    /**
+     * @brief 屏障: 等待调用前已入队的事件全部写出, 再刷新被装饰的输出器
+     */
+    void flush() override;
+    /**
+     * @brief 只写出被装饰输出器的缓冲, 队列中尚未取出的事件丢失
+     */
+    void drain() override { appender_->drain(); }
+    void setFormatter(LogFormatter::ptr val) override;
+    bool isBinary() const override { return appender_->isBinary(); }
+    std::string getName() const override { return "async:" + appender_->getName(); }
+    /**
+     * @brief 事件数为入队的事件数, 字节数与耗时取自被装饰的输出器, 另含队列深度与丢弃数
+     */
+    void collectMetrics(LogMetrics::AppenderStats& stats) const override;
+
+    LogAppender::ptr getAppender() const { return appender_; }
+    OverflowPolicy getPolicy() const { return options_.policy; }
+    uint64_t getDropped() const { return dropped_.load(std::memory_order_relaxed); }
+    size_t getQueueSize() const;
+
+private:
+    void run(size_t worker);
+    bool drain(size_t worker);
+    void wakeup();
+    void stop();
+
+private:
+    LogAppender::ptr appender_;                         // 被装饰的输出器
+    Options options_;
+    std::vector<std::unique_ptr<RingQueue>> queues_;    // 环形队列
+    std::vector<std::thread> workers_;                  // 后台线程
+    std::unique_ptr<std::atomic<uint64_t>[]> passes_;  // 各后台线程完成的轮数
+    std::atomic<bool> running_{true};
+    std::atomic<uint64_t> dropped_{0};                  // 丢弃事件数
+    std::atomic<int> sleepers_{0};                      // 休眠中的后台线程数
+    std::atomic<int> flushers_{0};                      // 等待 flush 的线程数
+    std::mutex wait_mutex_;
+    std::condition_variable wait_cv_;                   // 唤醒后台线程
+    std::condition_variable flush_cv_;                  // 通知 flush 等待者
+};
+
+}// namespace log4cpp
+
+#endif // __ASYNC_HPP__
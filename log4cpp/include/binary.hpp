@@ -0,0 +1,126 @@
+#ifndef __BINARY_HPP__
+#define __BINARY_HPP__
+
+#include "log.hpp"
+
+namespace log4cpp {
+
+/**
+ * @brief 二进制日志文件格式(主机字节序)
+ * @details
+ *  文件头: "L4CB" + uint32 版本号 + int64 进程启动的纳秒时间戳(用于还原 elapse).
+ *  每次打开文件都会写文件头并重写完整的调用点字典和线程字典,
+ *  解码器遇到文件头时清空字典, 因此追加写入同一文件或外部轮转后的新文件都能独立解码.
+ *  记录: uint8 类型 + 内容, 字符串为 uint32 长度 + 字节
+ *   site   : uint32 id, uint8 级别, int32 行号, 文件名, 函数名, 格式串, 日志器名称
+ *   thread : uint32 id, uint64 线程id(gettid), uint32 协程id, 线程名称;
+ *            每个 (线程, 协程, 线程名称) 组合首次出现时写入一次
+ *   event  : uint32 调用点 id, int64 纳秒时间戳, uint32 线程记录 id,
+ *            uint8 是否文本, 内容(文本或 detail::EncodeArg 编码的参数), 结构化字段(LogStream::kv 的编码)
+ */
+namespace binary {
+constexpr char kMagic[4] = {'L', '4', 'C', 'B'};
+constexpr uint32_t kVersion = 1;
+enum RecordType : uint8_t{
+    kSiteRecord = 1,
+    kEventRecord = 2,
+    kThreadRecord = 3
+};
+} // namespace binary
+
+/**
+ * @brief 二进制文件输出器
+ * @details 配合 LOG4CPP_BIN_* 宏使用: 事件只写入调用点 id、原始时间戳和参数字节,
+ *          调用点元数据(格式串/文件名/行号/级别/日志器名称)在首次出现时写入字典.
+ *          渲染留给 log4cpp-decode 离线完成. 普通宏产生的文本事件按文本记录.
+ *          写出策略与轮转检测同 FileLogAppender.
+ */
+class BinaryLogAppender : public FileLogAppender{
+public:
+    using ptr = std::shared_ptr<BinaryLogAppender>;
+
+    BinaryLogAppender(const std::string& filename);
+    BinaryLogAppender(const std::string& filename, const FlushPolicy& policy);
+
+    void log(LogEvent::ptr event) override;
+    bool acceptsFormatted() const override { return false; }
+    bool isBinary() const override { return true; }
+    std::string getName() const override { return "binary:" + filename_; }
+
+protected:
+    bool reopenLocked() override;
+
+private:
+    // 返回事件所属调用点的 id, 首次出现时写入字典记录
+    uint32_t siteIdLocked(const LogEvent& event);
+    // 返回事件所在线程的记录 id, 首次出现时写入字典记录
+    uint32_t threadIdLocked(const LogEvent& event);
+    void writeHeaderLocked();
+    void writeSiteLocked(uint32_t id);
+    void writeThreadLocked(uint32_t id);
+
+private:
+    struct SiteKey{
+        const LogSite* site;
+        const Logger* logger;
+        bool operator==(const SiteKey& rhs) const { return site == rhs.site && logger == rhs.logger; }
+    };
+    struct SiteKeyHash{
+        size_t operator()(const SiteKey& key) const {
+            return std::hash<const void*>()(key.site) * 31 + std::hash<const void*>()(key.logger);
+        }
+    };
+    struct SiteEntry{
+        const LogSite* site;
+        std::string logger;
+    };
+    std::unordered_map<SiteKey, uint32_t, SiteKeyHash> ids_;
+    std::vector<SiteEntry> sites_;              // 按 id 排列
+
+    struct ThreadEntry{
+        uint32_t tid;
+        uint32_t fiber_id;
+        std::string name;
+    };
+    std::unordered_map<uint64_t, uint32_t> thread_ids_;    // (tid << 32 | fiber_id) -> id
+    std::vector<ThreadEntry> threads_;          // 按 id 排列
+};
+
+/**
+ * @brief 二进制日志解码器, 用任意 LogFormatter 模板把二进制日志渲染回文本
+ */
+class BinaryLogDecoder{
+public:
+    BinaryLogDecoder(LogFormatter::ptr formatter);
+
+    bool decode(std::string_view data, std::ostream& os);
+    bool decodeFile(const std::string& filename, std::ostream& os);
+
+    const std::string& getError() const { return error_; }
+
+private:
+    struct Thread{
+        uint32_t tid = 0;
+        uint32_t fiber_id = 0;
+        std::string name;
+    };
+    struct Site{
+        LogSite site;
+        std::string file;
+        std::string func;
+        std::string fmt;
+        Logger::ptr logger;
+    };
+    Logger::ptr getLogger(const std::string& name);
+
+private:
+    LogFormatter::ptr formatter_;
+    std::unordered_map<uint32_t, std::unique_ptr<Site>> sites_;
+    std::unordered_map<uint32_t, Thread> threads_;
+    std::unordered_map<std::string, Logger::ptr> loggers_;
+    std::string error_;
+};
+
+}// namespace log4cpp
+
+#endif // __BINARY_HPP__
@@ -0,0 +1,143 @@
+#ifndef __CONFIG_HPP__
+#define __CONFIG_HPP__
+
+#include "log.hpp"
+
+#include <map>
+
+namespace log4cpp {
+
+/**
+ * @brief 配置文件的内容
+ * @details INI 子集, '#' 或 ';' 开头的行为注释, 键值为 key = value:
+ *
+ *  [appender.console]
+ *  type = stdout                   ; stdout | stderr | file | rolling | binary | syslog | udp | tcp
+ *  pattern = %d%T[%p]%T[%c]%T%m%n  ; 不设置时使用日志器的模板
+ *  color = true                    ; stdout/stderr
+ *
+ *  [appender.app]
+ *  type = rolling
+ *  file = logs/app.log             ; file/rolling/binary
+ *  max_bytes = 100M                ; rolling, 可带 K/M/G 后缀
+ *  max_files = 10                  ; rolling
+ *  interval = 86400                ; rolling, 按时间滚动的秒数
+ *  compress = gzip                 ; rolling, gzip | none
+ *  flush_bytes = 64K               ; file/rolling/binary, syslog/udp/tcp 为攒批字节数
+ *  flush_interval = 1000           ; file/rolling/binary/syslog/udp/tcp, 毫秒; file/rolling/binary 为 0 时逐条写出, 负数时不按时间写出
+ *  async = true                    ; 包装成 AsyncLogAppender
+ *  queue_capacity = 8192           ; async
+ *
+ *  [appender.collector]
+ *  type = tcp
+ *  address = 127.0.0.1             ; syslog 为 Unix 套接字路径(默认 /dev/log), udp/tcp 为主机名或 IP
+ *  port = 6514                     ; udp/tcp
+ *  syslog = true                   ; RFC 5424 报文头
+ *  spill_bytes = 4M                ; 对端不可用时最多暂存的字节数
+ *
+ *  [logger.root]
+ *  level = info                    ; debug | info | warn | error | fatal, 不设置时继承父节点
+ *  appenders = console, app
+ *
+ *  [logger.net.http]
+ *  level = debug
+ *  additivity = false
+ *  pattern = %d [%p] %m%n          ; 日志器的默认模板
+ *  appenders = app
+ */
+struct LogConfig{
+    struct AppenderEntry{
+        std::string name;
+        std::map<std::string, std::string> options;
+        int line = 0;                               // 所在行号, 用于报错
+    };
+    struct LoggerEntry{
+        std::string name;
+        std::optional<LogLevel::Level> level;       // 为空时继承父节点
+        bool additive = true;
+        std::string pattern;
+        std::vector<std::string> appenders;
+        int line = 0;
+    };
+
+    std::vector<AppenderEntry> appenders;
+    std::vector<LoggerEntry> loggers;
+
+    /**
+     * @brief 解析配置文本
+     * @param[out] error 失败时的原因(含行号)
+     */
+    static bool Parse(std::string_view text, LogConfig& config, std::string& error);
+};
+
+/**
+ * @brief 配置加载器
+ * @details
+ *  load 先解析文件, 检查全部输出器的选项和日志器的模板与输出器引用, 都通过后才创建输出器,
+ *  因此有错误的配置不会打开/截断文件、启动线程或建立连接, 原有配置保持不变;
+ *  成功后在层级锁内一次性替换所有涉及的日志器的级别、可加和属性与输出器, 再统一发布快照.
+ *  记录日志的线程不加锁, 每次调用读到的级别与输出器来自同一个快照, 要么全是旧配置要么全是新配置.
+ *  上一次配置中出现而本次没有出现的日志器恢复为继承级别、可加和、没有自身的输出器.
+ *  与上一次配置中同名且选项完全相同的输出器沿用原对象, 缓冲、文件位置与连接不受重新加载影响;
+ *  其余输出器重新创建, 旧的输出器在最后一个引用释放时写出缓冲并关闭.
+ *
+ *  watch 用 inotify 监视配置文件所在目录, 文件被写入或替换(编辑器的 rename 方式保存)后自动重新加载,
+ *  加载失败时把原因输出到标准输出并保留原有配置.
+ *
+ *  auto loader = std::make_shared<log4cpp::ConfigLoader>("log4cpp.ini");
+ *  if(!loader->load()) std::cerr << loader->getError();
+ *  loader->watch();
+ */
+class ConfigLoader{
+public:
+    using ptr = std::shared_ptr<ConfigLoader>;
+
+    ConfigLoader(const std::string& path);
+    ~ConfigLoader();
+
+    /**
+     * @brief 读取并应用配置文件
+     */
+    bool load();
+    /**
+     * @brief 应用已解析的配置
+     */
+    bool apply(const LogConfig& config);
+    /**
+     * @brief 启动后台线程监视配置文件, 重复调用无副作用
+     */
+    bool watch();
+    void stop();
+
+    const std::string& getPath() const { return path_; }
+    std::string getError() const;
+    /**
+     * @brief 成功应用配置的次数
+     */
+    uint64_t getGeneration() const { return generation_.load(std::memory_order_acquire); }
+
+private:
+    void run();
+    void setError(const std::string& error);
+
+private:
+    std::string path_;
+    std::mutex apply_mutex_;                        // 串行化 load/apply
+    struct Loaded{
+        std::map<std::string, std::string> options;
+        LogAppender::ptr appender;
+    };
+
+    std::vector<std::string> configured_;           // 上一次配置涉及的日志器
+    std::map<std::string, Loaded> appenders_;       // 上一次配置创建的输出器, 按名称
+    mutable std::mutex error_mutex_;
+    std::string error_;
+    std::atomic<uint64_t> generation_{0};
+    std::thread watcher_;
+    int inotify_fd_ = -1;
+    int stop_fd_ = -1;                              // eventfd, 通知监视线程退出
+};
+
+}// namespace log4cpp
+
+#endif // __CONFIG_HPP__
@@ -0,0 +1,39 @@
+#ifndef __CRASH_HPP__
+#define __CRASH_HPP__
+
+#include "log.hpp"
+
+namespace log4cpp {
+
+/**
+ * @brief 崩溃处理
+ * @details
+ *  Install 之后, 进程收到 SIGSEGV/SIGABRT/SIGBUS/SIGFPE/SIGILL 或调用 std::terminate 时,
+ *  先对所有已登记的输出器调用 LogAppender::drain, 用 write(2) 写出用户态缓冲中尚未落地的日志,
+ *  再交还给原来的处理函数(默认为终止进程并生成 core).
+ *  StdoutLogAppender 与 FileLogAppender(及其派生类)在构造时自动登记.
+ *  异步输出器队列中尚未取出的事件需要格式化才能写出, 崩溃时无法安全处理, 会丢失;
+ *  fatal 级别的事件在返回前已同步刷新所有输出器, 不受影响.
+ *
+ *  log4cpp::CrashHandler::Install();
+ */
+class CrashHandler{
+public:
+    /**
+     * @brief 安装信号处理函数与 std::terminate 处理函数, 重复调用无副作用
+     * @details 同时为调用线程设置备用信号栈, 栈溢出引起的 SIGSEGV 也能得到处理
+     */
+    static void Install();
+    /**
+     * @brief 写出所有已登记输出器的缓冲, 异步信号安全, 只有第一次调用生效
+     */
+    static void Drain();
+
+    // 登记/注销需要在崩溃时写出缓冲的输出器, 由输出器在构造/析构时调用
+    static void Register(LogAppender* appender);
+    static void Unregister(LogAppender* appender);
+};
+
+}// namespace log4cpp
+
+#endif // __CRASH_HPP__
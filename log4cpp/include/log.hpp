@@ -2,6 +2,8 @@
 #define __LOG_HPP__
 
 #include <string>
+#include <string_view>
+#include <atomic>
 #include <memory>
 #include <iostream>
 #include <fstream>
@@ -9,6 +11,8 @@
 #include <chrono>
 #include <thread>
 #include <mutex>
+#include <condition_variable>
+#include <shared_mutex>
 #include <list>
 #include <vector>
 #include <tuple>
@@ -16,7 +20,18 @@
 #include <unordered_map>
 #include <iomanip>
 #include <functional>
+#include <optional>
 #include <cstdarg>
+#include <cstring>
+#include <charconv>
+#include <type_traits>
+#include <concepts>
+#include <array>
+#include <utility>
+#include <algorithm>
+#if __has_include(<format>)
+#include <format>
+#endif
 
 namespace log4cpp {
 
@@ -35,44 +50,625 @@ public:
         fatal = 5
     };
     static const char* ToString(LogLevel::Level level);
-    static LogLevel::Level FromString(const std::string& str);
+    static constexpr LogLevel::Level FromString(std::string_view str){
+#define XX(level, v) \
+        if(str == #v)\
+            return LogLevel::Level::level;
+        XX(debug, debug)
+        XX(info, info)
+        XX(warn, warn)
+        XX(error, error)
+        XX(fatal, fatal)
+        XX(debug, DEBUG)
+        XX(info, INFO)
+        XX(warn, WARN)
+        XX(error, ERROR)
+        XX(fatal, FATAL)
+#undef XX
+        return LogLevel::Level::unknow;
+    }
+};
+
+/**
+ * @brief 日志调用点描述符
+ * @details 由 LOG/LOG_FMT 宏在每个调用点生成一个 static constexpr 实例,
+ *          LogEvent 只保存指向它的指针
+ */
+struct LogSite{
+    LogLevel::Level level;                                 // 日志级别
+    const char* file;                                      // 文件名
+    int32_t line;                                          // 行号
+    const char* func;                                      // 函数名
+    const char* fmt = nullptr;                             // 延迟格式化的格式串, 仅二进制日志宏设置
+};
+
+
+/**
+ * @brief 字符缓冲
+ * @details 前 kInlineSize 字节放在对象内部, 超出后才在堆上扩容
+ */
+class LogBuffer{
+public:
+    using value_type = char;
+    static constexpr size_t kInlineSize = 512;
+
+    LogBuffer() = default;
+    ~LogBuffer() { release(); }
+    LogBuffer(const LogBuffer&) = delete;
+    LogBuffer& operator=(const LogBuffer&) = delete;
+
+    const char* data() const { return data_; }
+    char* data() { return data_; }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+    bool empty() const { return size_ == 0; }
+    std::string_view view() const { return std::string_view(data_, size_); }
+    void clear() { size_ = 0; }
+    /**
+     * @brief 截断到 size 字节, 不大于当前长度时才生效
+     */
+    void truncate(size_t size) { if(size < size_) size_ = size; }
+
+    void append(const char* str, size_t len) {
+        if(len > capacity_ - size_) grow(len);
+        std::memcpy(data_ + size_, str, len);
+        size_ += len;
+    }
+    void append(std::string_view str) { append(str.data(), str.size()); }
+    void push_back(char c) {
+        if(size_ == capacity_) grow(1);
+        data_[size_++] = c;
+    }
+    /**
+     * @brief 保证至少有 len 字节可写空间, 返回写入位置, 写完后用 commit 提交
+     */
+    char* prepare(size_t len) {
+        if(len > capacity_ - size_) grow(len);
+        return data_ + size_;
+    }
+    void commit(size_t len) { size_ += len; }
+    /**
+     * @brief 清空内容, 堆上缓冲超过 limit 字节时释放, 回到内联缓冲
+     */
+    void shrink(size_t limit);
+
+private:
+    void grow(size_t len);
+    void release();
+
+private:
+    char* data_ = inline_;
+    size_t size_ = 0;
+    size_t capacity_ = kInlineSize;
+    char inline_[kInlineSize];
 };
 
+class LogStreamBuf : public std::streambuf{
+public:
+    explicit LogStreamBuf(LogBuffer& buffer) : buffer_(buffer) {}
+protected:
+    int_type overflow(int_type c) override;
+    std::streamsize xsputn(const char* str, std::streamsize len) override;
+private:
+    LogBuffer& buffer_;
+};
+
+namespace detail {
+// 保证缓冲先于 std::ostream 基类构造
+struct LogStreamStorage{
+    LogBuffer buffer_;
+    LogStreamBuf streambuf_{buffer_};
+};
+} // namespace detail
 
+/**
+ * @brief 日志内容流
+ * @details 写入内联缓冲 LogBuffer, 整数/浮点数在默认格式下直接用 std::to_chars 转换,
+ *          字符串直接拷贝; 其余类型和改过格式标志的情况走 std::ostream 的原有路径.
+ */
+class LogStream : private detail::LogStreamStorage, public std::ostream{
+public:
+    LogStream() : std::ostream(&streambuf_) {}
+    /**
+     * @param[in] fields 结构化字段的存放位置, 由 LogEvent 提供
+     */
+    explicit LogStream(LogBuffer* fields) : std::ostream(&streambuf_), fields_(fields) {}
+
+    using std::ostream::operator<<;
+
+    LogStream& operator<<(const char* str) {
+        if(str && width() == 0) {
+            buffer_.append(str, std::strlen(str));
+        } else {
+            static_cast<std::ostream&>(*this) << str;
+        }
+        return *this;
+    }
+    LogStream& operator<<(std::string_view str) {
+        if(width() == 0) {
+            buffer_.append(str);
+        } else {
+            static_cast<std::ostream&>(*this) << str;
+        }
+        return *this;
+    }
+    LogStream& operator<<(const std::string& str) { return *this << std::string_view(str); }
+    LogStream& operator<<(char c) {
+        if(width() == 0) {
+            buffer_.push_back(c);
+        } else {
+            static_cast<std::ostream&>(*this) << c;
+        }
+        return *this;
+    }
+    LogStream& operator<<(short v) { return appendNumber(v); }
+    LogStream& operator<<(unsigned short v) { return appendNumber(v); }
+    LogStream& operator<<(int v) { return appendNumber(v); }
+    LogStream& operator<<(unsigned int v) { return appendNumber(v); }
+    LogStream& operator<<(long v) { return appendNumber(v); }
+    LogStream& operator<<(unsigned long v) { return appendNumber(v); }
+    LogStream& operator<<(long long v) { return appendNumber(v); }
+    LogStream& operator<<(unsigned long long v) { return appendNumber(v); }
+    LogStream& operator<<(float v) { return appendNumber(v); }
+    LogStream& operator<<(double v) { return appendNumber(v); }
+
+    // 其他可输出到 std::ostream 的类型, 保持链式调用仍落在 LogStream 上
+    template <typename T>
+        requires requires(std::ostream& os, const T& v) { os << v; }
+    LogStream& operator<<(const T& v) {
+        static_cast<std::ostream&>(*this) << v;
+        return *this;
+    }
+
+    /**
+     * @brief 附加一个结构化字段
+     *  LOG_INFO(logger).kv("user", id).kv("ms", dt) << "done";
+     * @details 值按类型编码保存(同 detail::EncodeArg), 不在调用处转成字符串;
+     *          只有事件的内容流带有字段缓冲, 其他 LogStream 上调用时忽略
+     */
+    template <typename T>
+    LogStream& kv(std::string_view key, const T& value);
+
+    std::string_view view() const { return buffer_.view(); }
+    std::string str() const { return std::string(buffer_.view()); }
+    LogBuffer& buffer() { return buffer_; }
+    const LogBuffer& buffer() const { return buffer_; }
+    /**
+     * @brief 清空内容并恢复默认格式标志
+     */
+    void reset();
+
+private:
+    // 默认格式标志下才走快速路径, 保证与 std::ostream 的输出一致
+    bool plain() const {
+        return width() == 0 && flags() == (std::ios_base::skipws | std::ios_base::dec);
+    }
+
+    template <typename T>
+    LogStream& appendNumber(T v) {
+        if(!plain()) {
+            static_cast<std::ostream&>(*this) << v;
+            return *this;
+        }
+        constexpr size_t kMaxLen = 64;
+        char* p = buffer_.prepare(kMaxLen);
+        std::to_chars_result r;
+        if constexpr (std::is_floating_point_v<T>) {
+            r = std::to_chars(p, p + kMaxLen, v, std::chars_format::general, static_cast<int>(precision()));
+        } else {
+            r = std::to_chars(p, p + kMaxLen, v);
+        }
+        buffer_.commit(r.ptr - p);
+        return *this;
+    }
+
+private:
+    LogBuffer* fields_ = nullptr;
+};
+
+namespace detail {
+// 非 constexpr 函数, 在 consteval 上下文中调用即产生编译错误
+void format_string_error(const char* message);
+
+// 只接受 "{}" 占位符和 "{{" "}}" 转义, 返回占位符个数
+consteval size_t count_format_fields(std::string_view str){
+    size_t count = 0;
+    for(size_t i=0; i<str.size(); ++i){
+        if(str[i] == '{'){
+            if(i + 1 < str.size() && str[i+1] == '{'){
+                ++i;
+            }
+            else if(i + 1 < str.size() && str[i+1] == '}'){
+                ++count;
+                ++i;
+            }
+            else{
+                format_string_error("log4cpp: only \"{}\" placeholders are supported");
+            }
+        }
+        else if(str[i] == '}'){
+            if(i + 1 < str.size() && str[i+1] == '}'){
+                ++i;
+            }
+            else{
+                format_string_error("log4cpp: unmatched '}' in format string");
+            }
+        }
+    }
+    return count;
+}
+
+template <typename... Args>
+class basic_format_string{
+public:
+    template <typename S>
+        requires std::convertible_to<const S&, std::string_view>
+    consteval basic_format_string(const S& str) : str_(str) {
+        if(count_format_fields(str_) != sizeof...(Args)){
+            format_string_error("log4cpp: format string does not match the number of arguments");
+        }
+    }
+    std::string_view get() const { return str_; }
+private:
+    std::string_view str_;
+};
+} // namespace detail
+
+/**
+ * @brief 编译期检查的格式串, 语法同 std::format 的 "{}"
+ * @details 标准库提供 <format> 时直接使用 std::format_string;
+ *          否则退化为只支持 "{}" 占位符和 "{{" "}}" 转义的实现, 占位符个数与参数个数不符时编译失败.
+ */
+#if defined(__cpp_lib_format)
+template <typename... Args>
+using format_string = std::format_string<Args...>;
+#else
+template <typename... Args>
+using format_string = detail::basic_format_string<std::type_identity_t<Args>...>;
+#endif
+
+/**
+ * @brief 延迟格式化(二进制日志)的格式串, 与标准库是否提供 <format> 无关, 始终只接受 "{}"
+ * @details 渲染由 LogEvent::materialize 与离线解码器完成, 不支持格式说明和位置参数,
+ *          如 "{:x}" "{0}" 在编译期报错
+ */
+template <typename... Args>
+using plain_format_string = detail::basic_format_string<std::type_identity_t<Args>...>;
+
+/**
+ * @brief 延迟格式化的参数编码
+ * @details 二进制日志宏只把参数的原始字节写入事件, 渲染推迟到需要文本时(LogEvent::materialize)
+ *          或离线解码时. 每个参数为 1 字节类型标记加主机字节序的值, 字符串为 4 字节长度加内容.
+ *          不属于以下类型的参数在记录时经 LogStream 渲染成字符串.
+ */
+namespace detail {
+enum class ArgTag : uint8_t{
+    i64 = 1,
+    u64 = 2,
+    f64 = 3,
+    boolean = 4,
+    character = 5,
+    string = 6,
+    pointer = 7
+};
+
+template <typename T>
+inline void PutArg(LogBuffer& buffer, ArgTag tag, const T& v){
+    char* p = buffer.prepare(1 + sizeof(T));
+    p[0] = static_cast<char>(tag);
+    std::memcpy(p + 1, &v, sizeof(T));
+    buffer.commit(1 + sizeof(T));
+}
+
+inline void PutStringArg(LogBuffer& buffer, std::string_view str){
+    PutArg(buffer, ArgTag::string, static_cast<uint32_t>(str.size()));
+    buffer.append(str);
+}
+
+// 渲染其他类型参数用的线程本地流
+LogStream& ArgStream();
+
+template <typename T>
+void EncodeArg(LogBuffer& buffer, const T& v){
+    using U = std::decay_t<T>;
+    if constexpr (std::is_same_v<U, bool>) {
+        PutArg(buffer, ArgTag::boolean, static_cast<uint8_t>(v));
+    } else if constexpr (std::is_same_v<U, char>) {
+        PutArg(buffer, ArgTag::character, v);
+    } else if constexpr (std::is_integral_v<U> && std::is_signed_v<U>) {
+        PutArg(buffer, ArgTag::i64, static_cast<int64_t>(v));
+    } else if constexpr (std::is_integral_v<U>) {
+        PutArg(buffer, ArgTag::u64, static_cast<uint64_t>(v));
+    } else if constexpr (std::is_floating_point_v<U>) {
+        PutArg(buffer, ArgTag::f64, static_cast<double>(v));
+    } else if constexpr (std::is_same_v<U, const char*> || std::is_same_v<U, char*>) {
+        if constexpr (std::is_pointer_v<std::remove_cvref_t<T>>) {
+            PutStringArg(buffer, v ? std::string_view(v) : std::string_view("(null)"));
+        } else {
+            // 字符数组不会为空
+            PutStringArg(buffer, std::string_view(v));
+        }
+    } else if constexpr (std::is_convertible_v<const U&, std::string_view>) {
+        PutStringArg(buffer, std::string_view(v));
+    } else if constexpr (std::is_pointer_v<U>) {
+        PutArg(buffer, ArgTag::pointer, reinterpret_cast<uint64_t>(static_cast<const void*>(v)));
+    } else {
+        LogStream& ss = ArgStream();
+        ss.reset();
+        ss << v;
+        PutStringArg(buffer, ss.view());
+    }
+}
+} // namespace detail
+
+/**
+ * 结构化字段的编码: 键为 ArgTag::string 编码的字符串, 紧跟 EncodeArg 编码的值
+ */
+template <typename T>
+LogStream& LogStream::kv(std::string_view key, const T& value)
+{
+    if(fields_){
+        detail::PutStringArg(*fields_, key);
+        detail::EncodeArg(*fields_, value);
+    }
+    return *this;
+}
+
+/**
+ * @brief 线程上下文: 线程号(gettid)、线程名称与协程号
+ * @details 每个线程在第一次记录日志时采集, 各字段随即渲染成文本, 格式化 %t/%N/%F 时只需拷贝.
+ *          线程名称取自 pthread_getname_np, 之后绕过 setThreadName 的改名不会被感知.
+ *          协程号由 setFiberIdProvider 注册的函数提供, 仅在变化时重新渲染.
+ */
+struct ThreadContext{
+    // 不超过 15 个字符的短文本(与内核线程名称长度上限一致)
+    struct Text{
+        char data[16] = {0};
+        uint8_t size = 0;
+
+        void assign(std::string_view str);
+        template <typename T>
+        void assign(T value) {
+            size = static_cast<uint8_t>(std::to_chars(data, data + sizeof(data), value).ptr - data);
+        }
+        std::string_view view() const { return std::string_view(data, size); }
+    };
+
+    uint32_t tid = 0;                       // 内核线程号
+    uint32_t fiber_id = 0;                  // 协程号
+    Text tid_text;
+    Text fiber_text;
+    Text name;
+
+    /**
+     * @brief 当前线程的上下文, 协程号在每次调用时刷新
+     */
+    static const ThreadContext& Current();
+};
+
+/**
+ * @brief 返回当前协程号的函数, 不设置时协程号为 0
+ */
+using FiberIdProvider = uint32_t (*)();
+
+/**
+ * @brief 注册协程号提供函数, 可在任意时刻调用, nullptr 表示取消
+ */
+void setFiberIdProvider(FiberIdProvider provider);
+
+/**
+ * @brief 设置当前线程的名称(pthread_setname_np, 超过 15 个字符的部分被截断), 并更新日志上下文
+ */
+void setThreadName(std::string_view name);
+
+/**
+ * @brief 日志时间源
+ * @details 记录日志时只读取原始时间戳(LogClock::Now), 换算成墙钟时间推迟到格式化时进行.
+ *  - system: clock_gettime(CLOCK_REALTIME), 默认
+ *  - coarse: CLOCK_REALTIME_COARSE, 开销最小, 精度为一个时钟节拍(通常 1~4ms)
+ *  - tsc:    rdtsc, 切换时对照 CLOCK_REALTIME 校准约 10ms, 之后换算时每隔一秒按累积的基线重新校准.
+ *            仅在支持恒定 TSC 的 x86-64 上可用
+ *  时间源可以随时切换, 每个时间戳记录了产生它的时间源.
+ */
+class LogClock{
+public:
+    enum class Source : uint8_t{
+        system = 0,
+        coarse = 1,
+        tsc = 2
+    };
+    struct Stamp{
+        uint64_t ticks = 0;                 // system/coarse 为纪元起的纳秒数, tsc 为时间戳计数器
+        Source source = Source::system;
+    };
+
+    /**
+     * @brief 切换时间源
+     * @return 时间源不可用(如非 x86-64 或 TSC 不恒定)时返回 false, 不做切换
+     */
+    static bool SetSource(Source source);
+    static Source GetSource();
+
+    /**
+     * @brief 读取当前时间源的原始时间戳
+     */
+    static Stamp Now();
+    /**
+     * @brief 换算成纪元起的纳秒数
+     */
+    static int64_t ToNanoseconds(Stamp stamp);
+    static time_point ToTimePoint(Stamp stamp) {
+        return time_point(std::chrono::duration_cast<time_point::duration>(
+                std::chrono::nanoseconds(ToNanoseconds(stamp))));
+    }
+    static Stamp FromTimePoint(time_point time) {
+        return Stamp{static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+                time.time_since_epoch()).count()), Source::system};
+    }
+    /**
+     * @brief 进程启动(库初始化)时纪元起的纳秒数, elapse 以此为起点
+     */
+    static int64_t StartNanoseconds();
+};
+
+class LogEventPtr;
+
+/**
+ * @brief 日志事件
+ * @details 事件对象由 LogEvent::Create 从线程本地对象池取出, 引用计数归零后回收到池中,
+ *          内容缓冲随对象一起复用, 稳定状态下记录一条日志不需要分配堆内存.
+ *          事件只保存 Logger 的裸指针, 日志器需要比尚未写出的事件(如异步队列中的)活得更久.
+ */
 class LogEvent{
+friend class LogEventPtr;
+friend class LogEventPool;
 public:
-    using ptr = std::shared_ptr<LogEvent>;
-    LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, 
-            const char* filename, int32_t line, uint32_t elapse,
-            std::thread::id thread_id, uint32_t fiber_id, time_point time, 
-            const std::string& thread_name);
-
-    const char* getFile() const { return filename_; }
-    int32_t getLine() const { return line_; }
-    uint32_t getElapse() const { return elapse_; }
-    std::thread::id getThreadId() const { return threadId_; }
-    const std::string& getThreadName() const { return threadName_; }
-    uint32_t getFiberId() const { return fiberId_; }
-    time_point getTime() const { return time_; }
+    using ptr = LogEventPtr;
+    LogEvent(Logger* logger, const LogSite* site, uint32_t elapse,
+            uint32_t thread_id, uint32_t fiber_id, time_point time, 
+            std::string_view thread_name);
+
+    /**
+     * @brief 从对象池获取一个事件
+     */
+    static LogEvent::ptr Create(Logger* logger, const LogSite* site, uint32_t elapse,
+            uint32_t thread_id, uint32_t fiber_id, time_point time, 
+            std::string_view thread_name);
+    /**
+     * @brief 从对象池获取一个事件, 线程信息取自当前线程的 ThreadContext,
+     *        时间取自 LogClock, 墙钟时间与 elapse 在首次读取时换算
+     */
+    static LogEvent::ptr Create(Logger* logger, const LogSite* site);
+
+    const LogSite* getSite() const { return site_; }
+    const char* getFile() const { return site_->file; }
+    int32_t getLine() const { return site_->line; }
+    const char* getFunction() const { return site_->func; }
+    /**
+     * @brief 进程启动到事件发生的毫秒数
+     */
+    uint32_t getElapse() const;
+    uint32_t getThreadId() const { return thread_.tid; }
+    std::string_view getThreadIdText() const { return thread_.tid_text.view(); }
+    std::string_view getThreadName() const { return thread_.name.view(); }
+    uint32_t getFiberId() const { return thread_.fiber_id; }
+    std::string_view getFiberIdText() const { return thread_.fiber_text.view(); }
+    time_point getTime() const { return LogClock::ToTimePoint(stamp_); }
+    LogClock::Stamp getStamp() const { return stamp_; }
     std::string getContent() const { return ss_content_.str(); }
-    std::stringstream& getContentStream() { return ss_content_; }
-    LogLevel::Level getLevel() const { return level_; }
-    std::shared_ptr<Logger> getLogger() const { return logger_; }
+    std::string_view getContentView() const { return ss_content_.view(); }
+    LogStream& getContentStream() { return ss_content_; }
+    /**
+     * @brief 编码后的结构化字段(见 LogStream::kv), 没有字段时为空
+     */
+    std::string_view getFields() const { return fields_.view(); }
+    /**
+     * @brief 以已编码的字段替换现有字段, 供解码器使用
+     */
+    void setFields(std::string_view fields);
+    LogLevel::Level getLevel() const { return site_->level; }
+    Logger* getLogger() const { return logger_; }
 
     void format(const char* fmt, ...);
     void format(const char* fmt, va_list al);
+    /**
+     * @brief 按 "{}" 格式串把参数直接写入内容缓冲
+     */
+    template <typename... Args>
+    void print(format_string<Args...> fmt, Args&&... args) {
+#if defined(__cpp_lib_format)
+        std::format_to(std::back_inserter(ss_content_.buffer()), fmt, std::forward<Args>(args)...);
+#else
+        std::string_view rest = fmt.get();
+        ((rest = printField(rest), ss_content_ << args), ...);
+        printField(rest);
+#endif
+    }
+    /**
+     * @brief 二进制模式: 只记录参数的原始字节, 格式串取自调用点的 LogSite::fmt
+     * @details 延迟格式化只支持 "{}" 占位符和 "{{" "}}" 转义, 其余写法在编译期报错
+     */
+    template <typename... Args>
+    void record(plain_format_string<Args...>, Args&&... args) {
+        LogBuffer& buffer = ss_content_.buffer();
+        (detail::EncodeArg(buffer, args), ...);
+        binary_ = true;
+    }
+    /**
+     * @brief 内容是否为尚未渲染的二进制参数
+     */
+    bool isBinary() const { return binary_; }
+    /**
+     * @brief 以已编码的参数替换内容, 供解码器使用
+     */
+    void setBinaryContent(std::string_view args);
+    /**
+     * @brief 把二进制参数按格式串渲染成文本内容, 已是文本时不做任何事
+     */
+    void materialize();
+
+private:
+    LogEvent() = default;
+    void init(Logger* logger, const LogSite* site, std::optional<uint32_t> elapse,
+            const ThreadContext& thread, LogClock::Stamp stamp);
+    // 清空内容, 保留缓冲容量
+    void reset();
+    static void Recycle(LogEvent* event);
+    // 写入下一个占位符之前的字面文本, 返回占位符之后的剩余部分
+    std::string_view printField(std::string_view fmt);
 
 private:
-    const char* filename_ = nullptr;                       // 文件名
-    int32_t line_ = 0;                                     // 行号
-    uint32_t elapse_ = 0;                                  // 程序启动到现在的毫秒数
-    std::thread::id threadId_;                             // 线程Id
-    std::string threadName_;                               // 线程名称
-    uint32_t fiberId_ = 0;                                 // 协程Id
-    std::chrono::system_clock::time_point time_;           // 时间戳
-    std::stringstream ss_content_;                         // 内容
-    LogLevel::Level level_;                                // 日志级别
-    std::shared_ptr<Logger> logger_;                       // 日志器
+    const LogSite* site_ = nullptr;                        // 调用点(级别/文件名/行号/函数名)
+    std::optional<uint32_t> elapse_;                       // 程序启动到现在的毫秒数, 为空时按时间戳换算
+    ThreadContext thread_;                                 // 线程Id/线程名称/协程Id
+    LogClock::Stamp stamp_;                                // 时间戳
+    LogBuffer fields_;                                     // 结构化字段
+    LogStream ss_content_{&fields_};                       // 内容
+    bool binary_ = false;                                  // 内容为编码后的参数
+    Logger* logger_ = nullptr;                             // 日志器
+    std::atomic<uint32_t> refs_{0};                        // 引用计数
+    LogEvent* next_ = nullptr;                             // 空闲链表
+};
+
+/**
+ * @brief LogEvent 的侵入式智能指针, 引用计数归零时事件回到对象池
+ */
+class LogEventPtr{
+public:
+    LogEventPtr() = default;
+    LogEventPtr(std::nullptr_t) {}
+    explicit LogEventPtr(LogEvent* event) : event_(event) {
+        if(event_) event_->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    LogEventPtr(const LogEventPtr& rhs) : LogEventPtr(rhs.event_) {}
+    LogEventPtr(LogEventPtr&& rhs) noexcept : event_(rhs.event_) { rhs.event_ = nullptr; }
+    ~LogEventPtr() { reset(); }
+
+    LogEventPtr& operator=(const LogEventPtr& rhs) {
+        LogEventPtr(rhs).swap(*this);
+        return *this;
+    }
+    LogEventPtr& operator=(LogEventPtr&& rhs) noexcept {
+        LogEventPtr(std::move(rhs)).swap(*this);
+        return *this;
+    }
+
+    void reset() {
+        if(event_ && event_->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1){
+            LogEvent::Recycle(event_);
+        }
+        event_ = nullptr;
+    }
+    void swap(LogEventPtr& rhs) noexcept { std::swap(event_, rhs.event_); }
+
+    LogEvent* get() const { return event_; }
+    LogEvent* operator->() const { return event_; }
+    LogEvent& operator*() const { return *event_; }
+    explicit operator bool() const { return event_ != nullptr; }
+    bool operator==(const LogEventPtr& rhs) const { return event_ == rhs.event_; }
+
+private:
+    LogEvent* event_ = nullptr;
 };
 
 class LogEventWrap {
@@ -81,9 +677,9 @@ public:
     LogEventWrap(LogEvent::ptr e);
     ~LogEventWrap();
 
-    LogEvent::ptr getEvent() const { return event_; }
+    const LogEvent::ptr& getEvent() const { return event_; }
 
-    std::stringstream& getSS() { return event_->getContentStream(); }
+    LogStream& getSS() { return event_->getContentStream(); }
 private:
     LogEvent::ptr event_;
 };
@@ -108,37 +704,404 @@ public:
      *  %T 制表符
      *  %F 协程id
      *  %N 线程名称
+     *  %j 整条事件的 JSON 对象(时间/级别/日志器/线程/位置/消息/结构化字段), 见 JsonLogFormatter
+     *  %% 百分号
+     *
+     *  %d{...} 中除 strftime 的格式外还支持:
+     *   %ms %us %ns  毫秒/微秒/纳秒(3/6/9位)
+     *   UTC:...      以 UTC 渲染, 不做时区转换, 如 %d{UTC:%H:%M:%S.%ms}
+     *   ISO8601      UTC 的 ISO-8601 格式 2021-03-04T05:06:07.089Z
+     *  每个线程按秒缓存渲染结果, 同一秒内的后续日志只修补亚秒数字.
      *
      *  默认格式 "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"
+     *
+     *  模板在 init 中编译成一组扁平的指令, format 时按指令顺序追加到连续的字符缓冲.
      */
     LogFormatter(const std::string& pattern);
+    virtual ~LogFormatter() {}
 
 public:
-    class FormatItem{
-    public:
-        using ptr = std::shared_ptr<FormatItem>;
-        virtual ~FormatItem() {}
-        virtual void format(std::ostream& os, LogEvent::ptr event) = 0;
-        virtual std::string toString() const = 0;
-    
+    enum class OpCode : uint8_t{
+        literal = 0,        // 字面文本
+        message,            // %m
+        level,              // %p
+        elapse,             // %r
+        name,               // %c
+        thread_id,          // %t
+        newline,            // %n
+        datetime,           // %d
+        filename,           // %f
+        line,               // %l
+        tab,                // %T
+        fiber_id,           // %F
+        thread_name,        // %N
+        json                // %j
+    };
+
+    // 指令, offset/length 指向文本区中的字面文本或时间格式
+    struct Op{
+        OpCode code = OpCode::literal;
+        uint32_t offset = 0;
+        uint32_t length = 0;
     };
 
     void init();
     std::string format(LogEvent::ptr event);
     std::ostream& format(std::ostream& os, LogEvent::ptr event);
+    /**
+     * @brief 把事件格式化后追加到 buffer
+     */
+    virtual void format(LogBuffer& buffer, const LogEvent& event) const;
 
     bool isError() const {return error_;}
     const std::string& getPattern() const { return pattern_; }
-private:
+    const std::vector<Op>& getOps() const { return ops_; }
+
+    static constexpr std::string_view kDefaultDateFormat = "%Y-%m-%d %H:%M:%S";
+
+    /**
+     * @brief 解析格式模板, 每得到一段字面文本或一个格式项就调用 emit(code, text)
+     * @return 模板是否合法
+     */
+    template <typename Emit>
+    static constexpr bool Parse(std::string_view pattern, Emit&& emit);
+    static constexpr bool LookupOpCode(std::string_view name, OpCode& code);
+
+    /**
+     * @brief 执行单条指令
+     * @param[in] text 指令引用的文本区
+     */
+    static void Execute(const Op& op, const char* text, const LogEvent& event, LogBuffer& buffer);
+
+    /**
+     * @brief 追加 JSON 字符串(含引号), 转义 '"' '\\' 与控制字符, 其余字节(含 UTF-8)原样输出
+     * @details 支持 SSE2 时每次扫描 16 字节, 不需要转义的片段整段拷贝
+     */
+    static void AppendJsonString(LogBuffer& buffer, std::string_view str);
+
+protected:
+    static void AppendLoggerName(LogBuffer& buffer, const LogEvent& event);
+    static void AppendJson(LogBuffer& buffer, const LogEvent& event);
+    static void AppendDateTime(LogBuffer& buffer, time_point time, const char* format);
     template <typename T>
-    std::function<LogFormatter::FormatItem::ptr(const std::string& str)> create_format_item();
+    static void AppendNumber(LogBuffer& buffer, T value) {
+        char* p = buffer.prepare(24);
+        buffer.commit(std::to_chars(p, p + 24, value).ptr - p);
+    }
 
 private:
     std::string pattern_;                   // 格式模板
-    std::vector<FormatItem::ptr> items_;    // 格式项
+    std::vector<Op> ops_;                   // 指令
+    std::string text_;                      // 文本区: 字面文本与时间格式(以 '\0' 结尾)
     bool error_ = false;                    // 是否出错
 };
 
+template <typename Emit>
+constexpr bool LogFormatter::Parse(std::string_view pattern, Emit&& emit)
+{
+    bool ok = true;
+    size_t literal_begin = 0;
+    size_t i = 0;
+    while(i < pattern.size()){
+        if(pattern[i] != '%'){
+            ++i;
+            continue;
+        }
+        if(i > literal_begin){
+            emit(OpCode::literal, pattern.substr(literal_begin, i - literal_begin));
+        }
+        // %% 转义
+        if(i + 1 < pattern.size() && pattern[i+1] == '%'){
+            emit(OpCode::literal, pattern.substr(i, 1));
+            i += 2;
+            literal_begin = i;
+            continue;
+        }
+
+        size_t name_begin = ++i;
+        while(i < pattern.size() && ((pattern[i] >= 'a' && pattern[i] <= 'z') || (pattern[i] >= 'A' && pattern[i] <= 'Z'))){
+            ++i;
+        }
+        std::string_view name = pattern.substr(name_begin, i - name_begin);
+        std::string_view arg;
+        if(i < pattern.size() && pattern[i] == '{'){
+            size_t end = pattern.find('}', i + 1);
+            if(end == std::string_view::npos){
+                emit(OpCode::literal, std::string_view("<<pattern error>>"));
+                ok = false;
+                i = literal_begin = pattern.size();
+                break;
+            }
+            arg = pattern.substr(i + 1, end - i - 1);
+            i = end + 1;
+        }
+        literal_begin = i;
+
+        OpCode code = OpCode::literal;
+        if(!LookupOpCode(name, code)){
+            emit(OpCode::literal, std::string_view("<<error_format %"));
+            emit(OpCode::literal, name);
+            emit(OpCode::literal, std::string_view(">>"));
+            ok = false;
+            continue;
+        }
+        if(code == OpCode::datetime && arg.empty()){
+            arg = kDefaultDateFormat;
+        }
+        emit(code, arg);
+    }
+    if(literal_begin < pattern.size()){
+        emit(OpCode::literal, pattern.substr(literal_begin));
+    }
+    return ok;
+}
+
+constexpr bool LogFormatter::LookupOpCode(std::string_view name, OpCode& code)
+{
+#define XX(str, op) \
+    if(name == #str){ \
+        code = OpCode::op; \
+        return true; \
+    }
+    XX(m, message)              //m:消息
+    XX(p, level)                //p:日志级别
+    XX(r, elapse)               //r:累计毫秒数
+    XX(c, name)                 //c:日志名称
+    XX(t, thread_id)            //t:线程id
+    XX(n, newline)              //n:换行
+    XX(d, datetime)             //d:时间
+    XX(f, filename)             //f:文件名
+    XX(l, line)                 //l:行号
+    XX(T, tab)                  //T:Tab
+    XX(F, fiber_id)             //F:协程id
+    XX(N, thread_name)          //N:线程名称
+    XX(j, json)                 //j:JSON
+#undef XX
+    return false;
+}
+
+inline void LogFormatter::Execute(const Op& op, const char* text, const LogEvent& event, LogBuffer& buffer)
+{
+    switch(op.code){
+    case OpCode::literal:
+        buffer.append(text + op.offset, op.length);
+        break;
+    case OpCode::message:
+        buffer.append(event.getContentView());
+        break;
+    case OpCode::level:
+        buffer.append(std::string_view(LogLevel::ToString(event.getLevel())));
+        break;
+    case OpCode::elapse:
+        AppendNumber(buffer, event.getElapse());
+        break;
+    case OpCode::name:
+        AppendLoggerName(buffer, event);
+        break;
+    case OpCode::thread_id:
+        buffer.append(event.getThreadIdText());
+        break;
+    case OpCode::newline:
+        buffer.push_back('\n');
+        break;
+    case OpCode::datetime:
+        AppendDateTime(buffer, event.getTime(), text + op.offset);
+        break;
+    case OpCode::filename:
+        buffer.append(std::string_view(event.getFile()));
+        break;
+    case OpCode::line:
+        AppendNumber(buffer, event.getLine());
+        break;
+    case OpCode::tab:
+        buffer.push_back('\t');
+        break;
+    case OpCode::fiber_id:
+        buffer.append(event.getFiberIdText());
+        break;
+    case OpCode::thread_name:
+        buffer.append(event.getThreadName());
+        break;
+    case OpCode::json:
+        AppendJson(buffer, event);
+        break;
+    }
+}
+
+namespace detail {
+
+template <size_t N>
+struct FixedString{
+    char data[N] = {};
+    constexpr FixedString(const char (&str)[N]) {
+        for(size_t i=0; i<N; ++i){
+            data[i] = str[i];
+        }
+    }
+    constexpr std::string_view view() const { return std::string_view(data, N - 1); }
+};
+
+// 编译期指令程序, NOps/NText 为 0 时只统计大小
+template <size_t NOps, size_t NText>
+struct FormatProgram{
+    std::array<LogFormatter::Op, NOps> ops{};
+    std::array<char, NText> text{};
+    size_t op_count = 0;
+    size_t text_size = 0;
+    bool ok = true;
+    bool last_literal = false;
+
+    constexpr void emit(LogFormatter::OpCode code, std::string_view str){
+        bool literal = code == LogFormatter::OpCode::literal;
+        if(literal && last_literal){
+            if(op_count <= NOps) ops[op_count - 1].length += str.size();
+        }
+        else{
+            if(op_count < NOps) ops[op_count] = LogFormatter::Op{code, uint32_t(text_size), uint32_t(str.size())};
+            ++op_count;
+        }
+        for(char c : str){
+            if(text_size < NText) text[text_size] = c;
+            ++text_size;
+        }
+        if(code == LogFormatter::OpCode::datetime){
+            if(text_size < NText) text[text_size] = '\0';
+            ++text_size;
+        }
+        last_literal = literal;
+    }
+};
+
+template <size_t NOps, size_t NText>
+constexpr FormatProgram<NOps, NText> CompilePattern(std::string_view pattern){
+    FormatProgram<NOps, NText> program;
+    program.ok = LogFormatter::Parse(pattern, [&](LogFormatter::OpCode code, std::string_view str){
+        program.emit(code, str);
+    });
+    return program;
+}
+
+} // namespace detail
+
+/**
+ * @brief 编译期已知模板的格式化器
+ * @details 模板在编译期解析, 每条指令展开成一次内联调用, 无循环与分派开销.
+ *  auto fmt = std::make_shared<log4cpp::StaticLogFormatter<"%d%T%p%T%m%n">>();
+ */
+template <detail::FixedString Pattern>
+class StaticLogFormatter : public LogFormatter{
+public:
+    StaticLogFormatter() : LogFormatter(std::string(Pattern.view())) {}
+
+    using LogFormatter::format;
+    void format(LogBuffer& buffer, const LogEvent& event) const override {
+        run(buffer, event, std::make_index_sequence<kProgram.op_count>());
+    }
+
+private:
+    template <size_t... I>
+    static void run(LogBuffer& buffer, const LogEvent& event, std::index_sequence<I...>) {
+        (Execute(kProgram.ops[I], kProgram.text.data(), event, buffer), ...);
+    }
+
+    static constexpr auto kSize = detail::CompilePattern<0, 0>(Pattern.view());
+    static_assert(kSize.ok, "invalid log4cpp pattern");
+    static constexpr auto kProgram = detail::CompilePattern<kSize.op_count, kSize.text_size>(Pattern.view());
+};
+
+/**
+ * @brief 每行一个 JSON 对象的格式化器, 模板为 "%j%n"
+ * @details 输出示例(一行):
+ *  {"time":"2021-03-04T05:06:07.089Z","level":"info","logger":"root","thread":1234,
+ *   "thread_name":"main","fiber":0,"file":"main.cpp","line":12,"func":"main","elapse":5,
+ *   "message":"done","fields":{"user":42,"ms":1.5}}
+ *  没有结构化字段时省略 "fields". 非有限的浮点数输出为 null.
+ */
+class JsonLogFormatter : public LogFormatter{
+public:
+    using ptr = std::shared_ptr<JsonLogFormatter>;
+    JsonLogFormatter() : LogFormatter("%j%n") {}
+};
+
+
+/**
+ * @brief 按线程分片的一组计数器
+ * @details 每个线程固定写入其中一个分片(一条缓存行), relaxed 原子加, 线程之间几乎没有竞争;
+ *          读取时对所有分片求和, 只用于统计, 不保证与其他计数器的一致性.
+ */
+template <size_t N>
+class ShardedCounters{
+public:
+    static constexpr size_t kShards = 16;
+
+    void add(size_t index, uint64_t value) {
+        slots_[Shard()].values[index].fetch_add(value, std::memory_order_relaxed);
+    }
+    uint64_t load(size_t index) const {
+        uint64_t sum = 0;
+        for(auto& slot : slots_){
+            sum += slot.values[index].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+private:
+    static size_t Shard() {
+        static std::atomic<size_t> s_next{0};
+        thread_local size_t t_shard = s_next.fetch_add(1, std::memory_order_relaxed) % kShards;
+        return t_shard;
+    }
+
+    struct alignas(64) Slot{
+        std::atomic<uint64_t> values[N] = {};
+    };
+    Slot slots_[kShards];
+};
+
+/**
+ * @brief 日志器与输出器的运行统计快照, 由 LoggerManager::getMetrics 生成
+ */
+struct LogMetrics{
+    // Logger 计数器下标: 0-5 为各级别输出的事件数
+    enum LoggerCounter : size_t{
+        kFiltered = 6,              // 被级别过滤的调用数
+        kLoggerCounters = 7
+    };
+    // LogAppender 计数器下标
+    enum AppenderCounter : size_t{
+        kEvents = 0,                // 收到的事件数
+        kBytes,                     // 写出的字节数
+        kFormatNs,                  // 格式化耗时
+        kWriteNs,                   // 写出(系统调用)耗时
+        kLockWaitNs,                // 等待输出器锁的时间
+        kAppenderCounters
+    };
+
+    struct LoggerStats{
+        std::string name;
+        uint64_t emitted[6] = {0};  // 按 LogLevel::Level 下标
+        uint64_t filtered = 0;
+    };
+    struct AppenderStats{
+        std::string name;
+        uint64_t events = 0;
+        uint64_t bytes = 0;
+        uint64_t format_ns = 0;
+        uint64_t write_ns = 0;
+        uint64_t lock_wait_ns = 0;
+        uint64_t queue_depth = 0;   // 仅异步输出器
+        uint64_t dropped = 0;       // 仅异步输出器
+    };
+
+    std::vector<LoggerStats> loggers;
+    std::vector<AppenderStats> appenders;
+
+    static uint64_t Now() {
+        return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+};
+
 
 class LogAppender{
 friend class Logger;
@@ -146,51 +1109,197 @@ public:
     using ptr = std::shared_ptr<LogAppender>;
     virtual ~LogAppender() {}
     virtual void log(LogEvent::ptr event) = 0;
-    void setFormatter(LogFormatter::ptr val);
+    /**
+     * @brief 是否接受 Logger 预先格式化好的文本
+     * @details 接受时 Logger 改为调用 logFormatted, 使用同一格式化器的输出器对每个事件只格式化一次.
+     *          默认不接受, Logger 调用 log(event)
+     */
+    virtual bool acceptsFormatted() const { return false; }
+    /**
+     * @brief 写出用 getFormatter() 格式化好的一条日志, 只在 acceptsFormatted 返回 true 时被调用
+     * @param[in] text 只在本次调用期间有效
+     */
+    virtual void logFormatted(const LogEvent& /*event*/, std::string_view /*text*/) {}
+    // 将缓冲中的内容落地, 默认无缓冲
+    virtual void flush() {}
+    /**
+     * @brief 崩溃时由 CrashHandler 调用, 用 write(2) 写出用户态缓冲中的内容
+     * @details 必须是异步信号安全的: 不加锁、不分配内存、不格式化. 默认无缓冲, 不做任何事
+     */
+    virtual void drain() {}
+    // 是否直接接收未渲染的二进制事件, 否则 Logger 在分发前先把事件渲染成文本
+    virtual bool isBinary() const { return false; }
+    virtual void setFormatter(LogFormatter::ptr val);
+    /**
+     * @brief 不加锁, 记录日志的路径上按事件调用
+     */
     LogFormatter::ptr getFormatter() const ;
     bool hasFormatter() const;
+    // 用于统计与自检报告的名称
+    virtual std::string getName() const { return "appender"; }
+    virtual void collectMetrics(LogMetrics::AppenderStats& stats) const;
 
 protected:
-    std::mutex mutex_;
+    // 加锁, 需要等待时计入 kLockWaitNs
+    std::unique_lock<std::mutex> lockMetered();
+
+protected:
+    mutable ShardedCounters<LogMetrics::kAppenderCounters> metrics_;
+    mutable std::mutex mutex_;
     bool hasFormatter_ = false;
-    LogFormatter::ptr formatter_ = nullptr;
+    LogFormatter::ptr formatter_ = nullptr;     // 由 mutex_ 保护
+
+private:
+    std::atomic<LogFormatter::ptr> published_formatter_;    // formatter_ 的无锁副本, 供 getFormatter 读取
 };
 
 
+/**
+ * @brief 标准输出/标准错误输出器
+ * @details 在调用线程内格式化到线程本地缓冲, 每条日志或每批日志用一次 write(2) 写出, 行不会被其他线程打断.
+ *          输出到终端时逐行写出, 不加锁; 重定向到文件或管道时先追加到共享缓冲,
+ *          达到 batch_bytes、遇到不低于 error 的事件时立即写出, 否则最迟在第一行进入缓冲 interval 之后
+ *          由共用的后台定时器写出, 程序空闲时缓冲中的日志也不会一直留在内存里.
+ *          不经过 std::cout, 与直接写 std::cout 的内容之间不保证先后顺序.
+ */
 class StdoutLogAppender : public LogAppender{
 public:
     using ptr = std::shared_ptr<StdoutLogAppender>;
+
+    enum class Target{
+        out = 1,
+        err = 2
+    };
+
+    struct Options{
+        Target target = Target::out;
+        bool color = false;                                     // 按级别输出 ANSI 颜色
+        size_t batch_bytes = 64 * 1024;                         // 非终端时攒批的字节数
+        std::chrono::milliseconds interval{100};                // 非终端时日志在缓冲中停留的最长时间, 0 为逐行写出, 负数为不按时间写出
+    };
+
+    StdoutLogAppender();
+    StdoutLogAppender(const Options& options);
+    ~StdoutLogAppender();
+
     void log(LogEvent::ptr event) override;
+    bool acceptsFormatted() const override { return true; }
+    void logFormatted(const LogEvent& event, std::string_view text) override;
+    void flush() override;
+    void drain() override;
+    std::string getName() const override { return options_.target == Target::err ? "stderr" : "stdout"; }
+
+    const Options& getOptions() const { return options_; }
+    bool isTty() const { return tty_; }
+
+private:
+    void formatColored(LogBuffer& buffer, const LogFormatter& formatter, const LogEvent& event);
+    // 写出一条完整的日志: 终端直接写出, 否则追加到 batch_
+    void write(std::string_view line, LogLevel::Level level);
+    // 需持有 mutex_
+    void flushLocked();
+    void writeAll(const char* data, size_t len);
+
+private:
+    Options options_;
+    int fd_;
+    bool tty_;
+    LogBuffer batch_;                                           // 非终端时待写出的内容
+    std::chrono::steady_clock::time_point pending_since_;       // batch_ 由空变为非空的时间
 };
 
 
+/**
+ * @brief 文件输出器
+ * @details 日志先格式化到用户态缓冲, 按 FlushPolicy 用 write 批量写入文件.
+ *          只在显式调用 reopen 或检测到文件被轮转(路径指向的 inode 变化)时重新打开文件.
+ */
 class FileLogAppender : public LogAppender{
 public:
     using ptr = std::shared_ptr<FileLogAppender>;
+
+    struct FlushPolicy{
+        size_t bytes = 64 * 1024;                               // 缓冲达到该字节数时写出
+        std::chrono::milliseconds interval{1000};               // 内容在缓冲中停留的最长时间, 到期由后台定时器写出; 0 为逐条写出, 负数为不按时间写出
+        LogLevel::Level level = LogLevel::Level::error;         // 不低于该级别的事件立即写出
+    };
+
     FileLogAppender(const std::string &filename);
+    FileLogAppender(const std::string &filename, const FlushPolicy& policy);
+    ~FileLogAppender();
+
     void log(LogEvent::ptr event) override;
+    bool acceptsFormatted() const override { return true; }
+    void logFormatted(const LogEvent& event, std::string_view text) override;
+    void flush() override;
+    void drain() override;
+    std::string getName() const override { return "file:" + filename_; }
+    /**
+     * @brief 写出缓冲后关闭并重新打开文件
+     */
     bool reopen();
 
-private:
+    const std::string& getFilename() const { return filename_; }
+    FlushPolicy getFlushPolicy();
+    void setFlushPolicy(const FlushPolicy& policy);
+
+protected:
+    // 以下函数需持有 mutex_
+    // 格式化事件追加到缓冲, 并按写出策略决定是否写出
+    void appendLocked(const LogEvent& event);
+    // 已向缓冲追加 bytes 字节后, 按写出策略决定是否写出
+    void commitLocked(size_t bytes, LogLevel::Level level);
+    bool flushLocked();
+    // 把缓冲写入已打开的文件, 不检查轮转
+    bool writeLocked();
+    virtual bool reopenLocked();
+    // 文件是否已被移走或替换
+    bool isRotated();
+
+protected:
     std::string filename_;
-    std::ofstream ofs_;
-    time_point last_time_;
+    FlushPolicy policy_;
+    int fd_ = -1;
+    LogBuffer buffer_;                                          // 待写出的内容
+    uint64_t file_size_ = 0;                                    // 当前文件大小(含缓冲)
+    uint64_t inode_ = 0;
+    uint64_t device_ = 0;
+    bool timer_pending_ = false;                                // 已登记定时写出
+    std::chrono::steady_clock::time_point pending_since_;       // 登记定时写出的时间
+    std::chrono::steady_clock::time_point last_check_;         // 上次检查轮转时间
 };
 
 
+/**
+ * @brief 日志器
+ * @details 由 LoggerManager 创建的日志器按名称中的 '.' 组成层级, 如 net.http.client 的父节点是 net.http,
+ *          顶层名称的父节点是 root; 缺失的祖先在创建时一并创建.
+ *  - 未显式设置级别时继承父节点的有效级别
+ *  - 可加和(additivity, 默认开启)时, 除自身的输出器外还输出到父节点的全部有效输出器, 同一输出器只输出一次
+ *  有效级别和展平后的输出器快照在配置变化时为自身及所有后代重新计算, 记录日志时只做一次原子读取.
+ *  所有配置修改由一把全局的层级锁串行化, 记录日志不加锁.
+ */
 class Logger{
 friend class LoggerManager;
+friend class ConfigLoader;
 public:
     using ptr = std::shared_ptr<Logger>;
 
     Logger(LogLevel::Level level = LogLevel::Level::debug, const std::string& name = "root");
 
+    /**
+     * @brief 分发到当前输出器快照, 不加锁; 增删输出器不会阻塞正在记录日志的线程
+     * @details 接受已格式化文本的输出器按格式化器分组, 每个格式化器只格式化一次, 其余输出器调用 log(event).
+     *          fatal 事件在返回前刷新自身的输出器(异步输出器等到事件写出)和所有已注册日志器的输出器,
+     *          进程随后退出时, 说明原因的日志已经落地
+     */
     void log(LogEvent::ptr event);
 
     void addAppender(LogAppender::ptr appender);
     void delAppender(LogAppender::ptr appender);
     void clearAppender();
 
+    // 已挂载标准输出器时不重复添加
     void addStdoutAppender();
     bool hasStdoutAppender() const;
     void addFileAppender(const std::string& filename);
@@ -199,24 +1308,78 @@ public:
     void setFormatter(std::string& val);
 
     const std::string& getName() const { return name_; }
-    LogFormatter::ptr getFormatter() const { return formatter_; }
+    LogFormatter::ptr getFormatter() const;
+    Logger* getParent() const { return parent_.get(); }
+    /**
+     * @brief 有效级别: 显式设置的级别, 否则为父节点的有效级别
+     */
     LogLevel::Level getLevel() const { 
-        return level_; 
+        return effective_level_.load(std::memory_order_relaxed); 
+    }
+    void setLevel(LogLevel::Level level);
+    /**
+     * @brief 取消显式设置的级别, 改为继承父节点(没有父节点时保持不变)
+     */
+    void unsetLevel();
+    bool hasLevel() const;
+    bool isEnabled(LogLevel::Level level) const {
+        return effective_level_.load(std::memory_order_relaxed) <= level;
     }
+    /**
+     * @brief 日志宏使用的级别检查, 同 isEnabled, 另外统计被过滤的调用
+     */
+    bool shouldLog(LogLevel::Level level) const {
+        if(isEnabled(level)){
+            return true;
+        }
+        metrics_.add(LogMetrics::kFiltered, 1);
+        return false;
+    }
+    void setAdditivity(bool additive);
+    bool getAdditivity() const;
+    // 自身挂载的输出器(不含继承的)
+    std::vector<LogAppender::ptr> getAppenders() const;
+    void collectMetrics(LogMetrics::LoggerStats& stats) const;
+
+private:
+    // 以下函数需持有层级锁
+    void addAppenderLocked(LogAppender::ptr appender);
+    void setParentLocked(Logger::ptr parent);
+    // 重新计算自身及后代的有效级别与输出器快照
+    void updateLocked();
+    static std::mutex& HierarchyMutex();
 
 private:
     static StdoutLogAppender::ptr stdout_appender_;
 
 private:
+    using AppenderList = std::vector<LogAppender::ptr>;
+    // 发布给记录日志线程的不可变快照, 修改时重新生成再整体替换
+    struct Snapshot{
+        LogLevel::Level level;                  // 有效级别
+        AppenderList appenders;                 // 展平去重后的输出器
+    };
+
     std::string name_;                          // 日志名称
-    std::list<LogAppender::ptr> appenders_;     // 日志输出器
+    AppenderList appenders_;                    // 自身的日志输出器
+    std::atomic<std::shared_ptr<const Snapshot>> effective_;       // 有效级别与含祖先的有效输出器
     LogFormatter::ptr formatter_;               // 日志格式化器
-    Logger::ptr root_;                          // 根日志器
-    LogLevel::Level level_;                     // 日志级别
-    std::mutex mutex_;                           // 线程锁
+    Logger::ptr parent_;                        // 父日志器
+    std::vector<Logger*> children_;             // 子日志器, 注册后不会销毁
+    LogLevel::Level level_;                     // 显式设置的级别
+    bool level_set_ = true;                     // 是否显式设置了级别
+    bool additive_ = true;                      // 是否同时输出到父节点
+    std::atomic<LogLevel::Level> effective_level_;  // 有效级别
+    mutable ShardedCounters<LogMetrics::kLoggerCounters> metrics_;
 };
 
 // 单例模式
+/**
+ * @brief 日志器注册表
+ * @details 按名称哈希分成 kShards 个分片, 每个分片一把读写锁;
+ *          查找只取分片的共享锁, 不同分片上的查找与注册互不影响.
+ *          日志器注册后不会被移除, 可以长期持有其裸指针(见 LOG4CPP_LOGGER).
+ */
 class LoggerManager{
 public:
     static LoggerManager& getInstance(){
@@ -228,25 +1391,175 @@ public:
 
     Logger::ptr getLogger(const std::string& name);
     Logger::ptr getRoot() const ;
+    /**
+     * @brief 刷新所有已注册日志器的输出器, 同一输出器只刷新一次
+     */
+    void flushAll();
+
+    /**
+     * @brief 所有已注册日志器及其输出器的统计快照, 同一输出器只出现一次
+     */
+    LogMetrics getMetrics();
+    /**
+     * @brief 每隔 interval 把统计快照以 info 级别写到 target, 重复调用会替换之前的设置
+     */
+    void startMetricsReport(Logger::ptr target, std::chrono::milliseconds interval);
+    void stopMetricsReport();
 
 private:
     LoggerManager();
+    ~LoggerManager();
     LoggerManager(const LoggerManager&) = delete;
     LoggerManager& operator=(const LoggerManager&) = delete;
 
+    static constexpr size_t kShards = 16;
+    struct alignas(64) Shard{
+        mutable std::shared_mutex mutex;
+        std::unordered_map<std::string, Logger::ptr> loggers;
+    };
+    Shard& getShard(const std::string& name);
+    // 所有已注册日志器的快照
+    std::vector<Logger::ptr> getLoggers();
+    // 不存在时创建并挂到父节点, level 为空时继承父节点的级别; 返回已注册的日志器
+    Logger::ptr getOrCreate(const std::string& name, std::optional<LogLevel::Level> level);
+
+    void reportMetrics(Logger* target);
+
 private:
-    std::unordered_map<std::string, Logger::ptr> loggers_;
+    std::array<Shard, kShards> shards_;
     Logger::ptr root_;
+    std::thread report_thread_;                 // 自检报告线程
+    std::mutex report_mutex_;
+    std::condition_variable report_cv_;
+    bool report_stop_ = false;
+
+};
+
+namespace detail {
+/**
+ * @brief 调用点级别的限流状态, 由 LOG_EVERY_N 等宏以函数内 static 对象的形式持有
+ * @details 只用无锁原子操作; 判断在构造 LogEvent 之前完成.
+ *          按时间限流的两种在放行时先输出一条 "suppressed N messages" 汇总上一个窗口被丢弃的条数.
+ *          汇总只在调用点下一次被放行时输出, 没有后台线程也不在 flush/析构时补发:
+ *          调用点之后不再执行时, 最后一个窗口丢弃的条数不会输出.
+ */
+class EveryN{
+public:
+    bool allow(uint64_t n) {
+        return n <= 1 || count_.fetch_add(1, std::memory_order_relaxed) % n == 0;
+    }
+private:
+    std::atomic<uint64_t> count_{0};
+};
 
+class FirstN{
+public:
+    bool allow(uint64_t n) {
+        // 超过 n 次后只读不写, 避免热循环里反复争用同一缓存行
+        return count_.load(std::memory_order_relaxed) < n
+            && count_.fetch_add(1, std::memory_order_relaxed) < n;
+    }
+private:
+    std::atomic<uint64_t> count_{0};
 };
 
-#define LOG(logger, level) \
-    if(logger->getLevel() <= log4cpp::LogLevel::FromString(level)) \
-        log4cpp::LogEventWrap(log4cpp::LogEvent::ptr(new log4cpp::LogEvent(logger, log4cpp::LogLevel::FromString(level), \
-                        __FILE__, __LINE__, 0, \
-                std::this_thread::get_id(), 0, \
-                std::chrono::system_clock::now(), \
-                "main"))).getSS()
+// 输出被限流丢弃的条数
+void LogSuppressed(Logger* logger, const LogSite* site, uint64_t count);
+
+inline int64_t SteadyNowNs() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+class EveryT{
+public:
+    bool allow(double seconds, Logger* logger, const LogSite* site) {
+        int64_t now = SteadyNowNs();
+        int64_t next = next_.load(std::memory_order_relaxed);
+        if(now < next || !next_.compare_exchange_strong(next, now + static_cast<int64_t>(seconds * 1e9),
+                    std::memory_order_relaxed)){
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        if(uint64_t n = suppressed_.exchange(0, std::memory_order_relaxed)){
+            LogSuppressed(logger, site, n);
+        }
+        return true;
+    }
+private:
+    std::atomic<int64_t> next_{0};              // 下一个窗口的开始时间
+    std::atomic<uint64_t> suppressed_{0};
+};
+
+/**
+ * @brief 令牌桶限流, 以 GCRA(理论到达时间)实现: 平均每秒 per_sec 条, 最多突发 per_sec 条
+ */
+class RateLimiter{
+public:
+    bool allow(double per_sec, Logger* logger, const LogSite* site) {
+        if(per_sec <= 0){
+            suppressed_.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        int64_t interval = static_cast<int64_t>(1e9 / per_sec);
+        int64_t burst = static_cast<int64_t>(std::max(per_sec, 1.0) - 1) * interval;
+        int64_t now = SteadyNowNs();
+        int64_t tat = tat_.load(std::memory_order_relaxed);
+        for(;;){
+            int64_t start = std::max(tat, now);
+            if(start - now > burst){
+                suppressed_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            if(tat_.compare_exchange_weak(tat, start + interval, std::memory_order_relaxed)){
+                break;
+            }
+        }
+        if(uint64_t n = suppressed_.exchange(0, std::memory_order_relaxed)){
+            LogSuppressed(logger, site, n);
+        }
+        return true;
+    }
+private:
+    std::atomic<int64_t> tat_{0};               // 理论到达时间
+    std::atomic<uint64_t> suppressed_{0};
+};
+} // namespace detail
+
+/**
+ * 编译期最低日志级别, 低于该级别的 LOG/LOG_FMT 语句不生成任何代码
+ * 0 unknow, 1 debug, 2 info, 3 warn, 4 error, 5 fatal
+ */
+#ifndef LOG4CPP_MIN_LEVEL
+#define LOG4CPP_MIN_LEVEL 0
+#endif
+
+#define LOG4CPP_STRIPPED(lvl) \
+    (log4cpp::LogLevel::FromString(lvl) < log4cpp::LogLevel::Level(LOG4CPP_MIN_LEVEL))
+
+#define LOG4CPP_SITE(lvl) \
+    static constexpr log4cpp::LogSite log4cpp_site_{log4cpp::LogLevel::FromString(lvl), \
+                        __FILE__, __LINE__, __func__}
+
+#define LOG4CPP_EVENT(logger) \
+    log4cpp::LogEventWrap(log4cpp::LogEvent::Create(&*(logger), &log4cpp_site_))
+
+#define LOG(logger, lvl) \
+    if constexpr(LOG4CPP_STRIPPED(lvl)) {} else \
+    if(LOG4CPP_SITE(lvl); logger->shouldLog(log4cpp_site_.level)) \
+        LOG4CPP_EVENT(logger).getSS()
+
+/**
+ * @brief 按名称取日志器, 每个调用点只在第一次执行时查询注册表, 之后直接使用缓存的 Logger*
+ *  LOG_INFO(LOG4CPP_LOGGER("net.http")) << "connected";
+ * name 须为常量表达式(如字符串字面量)
+ */
+#define LOG4CPP_LOGGER(name) \
+    ([]() -> log4cpp::Logger* { \
+        static log4cpp::Logger* const log4cpp_logger_ = \
+                log4cpp::LoggerManager::getInstance().getLogger(name).get(); \
+        return log4cpp_logger_; \
+    }())
 
 #define LOG_DEBUG(logger) LOG(logger, "debug")
 #define LOG_INFO(logger) LOG(logger, "info")
@@ -254,6 +1567,28 @@ private:
 #define LOG_ERROR(logger) LOG(logger, "error")
 #define LOG_FATAL(logger) LOG(logger, "fatal")
 
+/**
+ * @brief 按调用点限流的流式日志宏
+ *  LOG_EVERY_N(logger, "warn", 100) << "retry";          // 第 1, 101, 201 ... 次
+ *  LOG_FIRST_N(logger, "error", 10) << "bad packet";     // 只输出前 10 次
+ *  LOG_EVERY_T(logger, "info", 1.5) << "progress";       // 每 1.5 秒最多一次
+ *  LOG_RATE_LIMITED(logger, "error", 100) << "timeout";  // 令牌桶, 平均每秒最多 100 条
+ * 后两种在窗口结束后的下一次输出前补一条 "suppressed N messages";
+ * 汇总随下一次放行输出, 调用点不再执行时最后一个窗口的丢弃条数不会输出
+ */
+#define LOG4CPP_LIMITED(logger, lvl, limiter, ...) \
+    if constexpr(LOG4CPP_STRIPPED(lvl)) {} else \
+    if(LOG4CPP_SITE(lvl); !logger->shouldLog(log4cpp_site_.level)) {} else \
+    if(static log4cpp::detail::limiter log4cpp_limiter_; !log4cpp_limiter_.allow(__VA_ARGS__)) {} else \
+        LOG4CPP_EVENT(logger).getSS()
+
+#define LOG_EVERY_N(logger, lvl, n) LOG4CPP_LIMITED(logger, lvl, EveryN, n)
+#define LOG_FIRST_N(logger, lvl, n) LOG4CPP_LIMITED(logger, lvl, FirstN, n)
+#define LOG_EVERY_T(logger, lvl, seconds) \
+    LOG4CPP_LIMITED(logger, lvl, EveryT, seconds, &*(logger), &log4cpp_site_)
+#define LOG_RATE_LIMITED(logger, lvl, per_sec) \
+    LOG4CPP_LIMITED(logger, lvl, RateLimiter, per_sec, &*(logger), &log4cpp_site_)
+
 #define debug() LOG_DEBUG(log4cpp::LoggerManager::getInstance().getRoot())
 #define info() LOG_INFO(log4cpp::LoggerManager::getInstance().getRoot())
 #define warn() LOG_WARN(log4cpp::LoggerManager::getInstance().getRoot())
@@ -261,13 +1596,47 @@ private:
 #define fatal() LOG_FATAL(log4cpp::LoggerManager::getInstance().getRoot())
 
 
-#define LOG_FMT(logger, level, fmt, ...) \
-    if(logger->getLevel() <= log4cpp::LogLevel::FromString(level))\
-        log4cpp::LogEventWrap(log4cpp::LogEvent::ptr(new log4cpp::LogEvent(logger, log4cpp::LogLevel::FromString(level), \
-                        __FILE__, __LINE__, 0, \
-                std::this_thread::get_id(), 0, \
-                std::chrono::system_clock::now(), \
-                "main"))).getEvent()->format(fmt, __VA_ARGS__)
+#define LOG_FMT(logger, lvl, fmt, ...) \
+    if constexpr(LOG4CPP_STRIPPED(lvl)) {} else \
+    if(LOG4CPP_SITE(lvl); logger->shouldLog(log4cpp_site_.level)) \
+        LOG4CPP_EVENT(logger).getEvent()->format(fmt, __VA_ARGS__)
+
+
+/**
+ * @brief std::format 风格的日志宏, 格式串在编译期检查
+ *  LOG4CPP_INFO(logger, "{} took {}us", name, us);
+ */
+#define LOG4CPP_LOG(logger, lvl, fmt, ...) \
+    if constexpr(LOG4CPP_STRIPPED(lvl)) {} else \
+    if(LOG4CPP_SITE(lvl); logger->shouldLog(log4cpp_site_.level)) \
+        LOG4CPP_EVENT(logger).getEvent()->print(fmt __VA_OPT__(,) __VA_ARGS__)
+
+#define LOG4CPP_DEBUG(logger, fmt, ...) LOG4CPP_LOG(logger, "debug", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_INFO(logger, fmt, ...) LOG4CPP_LOG(logger, "info", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_WARN(logger, fmt, ...) LOG4CPP_LOG(logger, "warn", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_ERROR(logger, fmt, ...) LOG4CPP_LOG(logger, "error", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_FATAL(logger, fmt, ...) LOG4CPP_LOG(logger, "fatal", fmt __VA_OPT__(,) __VA_ARGS__)
+
+
+/**
+ * @brief 二进制(延迟格式化)日志宏, 只记录调用点和参数的原始字节
+ *  LOG4CPP_BIN_INFO(logger, "{} took {}us", name, us);
+ * 配合 BinaryLogAppender 使用; 同一日志器上的文本输出器仍会收到渲染后的内容
+ */
+#define LOG4CPP_BIN_SITE(lvl, fmt) \
+    static constexpr log4cpp::LogSite log4cpp_site_{log4cpp::LogLevel::FromString(lvl), \
+                        __FILE__, __LINE__, __func__, fmt}
+
+#define LOG4CPP_BIN_LOG(logger, lvl, fmt, ...) \
+    if constexpr(LOG4CPP_STRIPPED(lvl)) {} else \
+    if(LOG4CPP_BIN_SITE(lvl, fmt); logger->shouldLog(log4cpp_site_.level)) \
+        LOG4CPP_EVENT(logger).getEvent()->record(fmt __VA_OPT__(,) __VA_ARGS__)
+
+#define LOG4CPP_BIN_DEBUG(logger, fmt, ...) LOG4CPP_BIN_LOG(logger, "debug", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_BIN_INFO(logger, fmt, ...) LOG4CPP_BIN_LOG(logger, "info", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_BIN_WARN(logger, fmt, ...) LOG4CPP_BIN_LOG(logger, "warn", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_BIN_ERROR(logger, fmt, ...) LOG4CPP_BIN_LOG(logger, "error", fmt __VA_OPT__(,) __VA_ARGS__)
+#define LOG4CPP_BIN_FATAL(logger, fmt, ...) LOG4CPP_BIN_LOG(logger, "fatal", fmt __VA_OPT__(,) __VA_ARGS__)
 
 
 inline Logger::ptr simple_init(std::string logger_name = "root", std::string type = "stdout"){
@@ -0,0 +1,109 @@
+#ifndef __MMAP_HPP__
+#define __MMAP_HPP__
+
+#include "log.hpp"
+
+#include <condition_variable>
+
+namespace log4cpp {
+
+/**
+ * @brief 内存映射文件输出器
+ * @details
+ *  日志写入预分配(fallocate)并映射的定长段文件 basename.000001, basename.000002 ...
+ *  写日志的线程在调用线程内格式化, 用原子 fetch_add 预留空间后直接 memcpy 到映射区,
+ *  除换段外不加锁也不进入内核. 段写满时由跨越段尾的那个线程把后台线程预先建好的下一段发布为当前段;
+ *  建段(fallocate/mmap)与旧段的解除映射、截断都在后台线程完成.
+ *  数据写入映射区后即在页缓存中, 进程崩溃后仍可读出; 未正常关闭的段末尾是 '\0' 填充.
+ *  正常关闭的段会被截断到实际长度, 未用到的预建段会被删除.
+ *  启动时从已有段的最大序号之后开始, 不续写旧段.
+ *
+ *  磁盘空间不足等原因无法预分配下一段时不映射稀疏文件(写入未分配的页会触发 SIGBUS),
+ *  而是对同名段文件改用加锁的 write(2) 追加, 写满一段后再尝试映射下一段;
+ *  连文件都无法打开或写入失败时丢弃该条日志并计入 getDropped(), 每 100ms 重试一次.
+ */
+class MmapFileAppender : public LogAppender{
+public:
+    using ptr = std::shared_ptr<MmapFileAppender>;
+
+    MmapFileAppender(const std::string& basename, size_t segment_size = 64 * 1024 * 1024);
+    ~MmapFileAppender();
+
+    void log(LogEvent::ptr event) override;
+    bool acceptsFormatted() const override { return true; }
+    void logFormatted(const LogEvent& event, std::string_view text) override;
+    /**
+     * @brief 发起当前段的异步回写(msync MS_ASYNC)
+     */
+    void flush() override;
+    std::string getName() const override { return "mmap:" + basename_; }
+    /**
+     * @brief dropped 为无法写入而丢弃的日志条数
+     */
+    void collectMetrics(LogMetrics::AppenderStats& stats) const override;
+
+    const std::string& getBasename() const { return basename_; }
+    size_t getSegmentSize() const { return segment_size_; }
+    uint64_t getSegmentIndex() const { return index_.load(std::memory_order_acquire); }
+    uint64_t getDropped() const { return dropped_.load(std::memory_order_relaxed); }
+
+private:
+    struct Segment{
+        std::string path;
+        uint64_t index = 0;
+        int fd = -1;
+        char* data = nullptr;
+        size_t size = 0;
+        size_t used = 0;                                // 封段时的有效长度
+        alignas(64) std::atomic<size_t> offset{0};      // 下一个写入位置
+        std::atomic<bool> sealed{false};                // 已切换到新段
+    };
+
+    // 写者计数, 按纪元分两组; 后台线程推进纪元并等旧组归零后, 已换下的段不再被任何写者访问
+    struct alignas(64) Readers{
+        std::atomic<uint64_t> count{0};
+    };
+
+    std::string segmentPath(uint64_t index) const;
+    // 创建、预分配并映射一段, 失败时删除文件并返回空; report 为 false 时不输出错误
+    std::unique_ptr<Segment> createSegment(uint64_t index, bool report);
+    // 把一条完整的日志拷贝进当前段, 超过段大小的部分截断
+    void write(std::string_view line);
+    // 没有映射段时用 write(2) 写入, 返回 false 表示映射段已恢复, 调用者应重试
+    bool writeFallback(std::string_view line);
+    void roll(Segment* segment, size_t used);
+    // 换到下一段(预建段、同步新建的段或 write(2) 文件), 调用时持有 roll_mutex_
+    void advanceLocked(std::unique_lock<std::mutex>& lock);
+    void openFallbackLocked();
+    void run();
+    void waitReaders();
+    void retire(Segment* segment);
+
+private:
+    std::string basename_;
+    size_t segment_size_;
+    std::atomic<Segment*> current_{nullptr};
+    std::atomic<uint64_t> index_{0};                    // 当前段序号
+    std::atomic<uint64_t> epoch_{0};
+    Readers readers_[2];
+    std::atomic<uint64_t> dropped_{0};
+
+    std::mutex roll_mutex_;
+    std::condition_variable cv_;
+    // 以下由 roll_mutex_ 保护
+    std::vector<std::unique_ptr<Segment>> segments_;    // 当前段、预建段与等待解除映射的段
+    std::vector<Segment*> retired_;                     // 已换下、等待写者退出的段
+    Segment* spare_ = nullptr;                          // 预建的下一段
+    uint64_t next_index_ = 0;                           // 下一段的序号
+    bool preparing_ = false;                            // 后台线程正在建段
+    std::chrono::steady_clock::time_point retry_at_;    // 建段或打开失败后下次重试的时间
+    int fallback_fd_ = -1;                              // 无法映射时 write(2) 的目标
+    bool failing_ = false;                              // 已输出过失败信息, 恢复映射前不再重复
+    size_t fallback_bytes_ = 0;
+    bool stopping_ = false;
+    std::thread worker_;
+};
+
+}// namespace log4cpp
+
+#endif // __MMAP_HPP__
@@ -0,0 +1,99 @@
+#ifndef __ROLLING_HPP__
+#define __ROLLING_HPP__
+
+#include "log.hpp"
+
+#include <condition_variable>
+#include <deque>
+
+namespace log4cpp {
+
+/**
+ * @brief 按大小/时间滚动的文件输出器
+ * @details
+ *  当前日志始终写入 filename, 滚动时把它改名为归档文件
+ *  filename + "." + strftime(pattern, 本段开始时间), 重名时再追加 ".1" ".2" ...
+ *  写日志的线程只把 filename 改名为 filename + ".<pid>.<序号>.roll", 确定归档名、压缩与保留策略的清理
+ *  都在后台线程完成; 写入进程已经退出而遗留的 .roll 文件在启动时补做归档.
+ *  保留策略只统计和删除符合上述归档名(可带 ".gz")的文件, 同目录下 filename.bak 等其他文件不受影响.
+ *
+ *  压缩只支持 gzip(zlib), 未引入 zstd 依赖; 编译时没有找到 zlib 时请求压缩会输出警告并退化为不压缩,
+ *  可用 CompressionAvailable 预先判断.
+ *
+ *  logger->addAppender(std::make_shared<RollingFileAppender>("app.log", options));
+ */
+class RollingFileAppender : public FileLogAppender{
+public:
+    using ptr = std::shared_ptr<RollingFileAppender>;
+
+    enum class Compression{
+        none = 0,
+        gzip = 1            // 需要编译时找到 zlib, 否则警告并退化为 none
+    };
+
+    /**
+     * @brief 当前构建是否支持该压缩方式
+     */
+    static bool CompressionAvailable(Compression compression);
+
+    struct Options{
+        uint64_t max_bytes = 100 * 1024 * 1024;     // 单个文件大小上限, 0 表示不按大小滚动
+        std::chrono::seconds interval{0};           // 按本地时间对齐的滚动周期, 0 表示不按时间滚动
+        std::string pattern = "%Y%m%d-%H%M%S";      // 归档文件名后缀(strftime 格式)
+        Compression compression = Compression::gzip;
+        size_t max_files = 0;                       // 最多保留的归档个数, 0 表示不限
+        uint64_t max_total_bytes = 0;               // 归档总字节数上限, 0 表示不限
+        FlushPolicy flush;                          // 写出策略
+    };
+
+    RollingFileAppender(const std::string& filename);
+    RollingFileAppender(const std::string& filename, const Options& options);
+    ~RollingFileAppender();
+
+    void log(LogEvent::ptr event) override;
+    void logFormatted(const LogEvent& event, std::string_view text) override;
+    std::string getName() const override { return "rolling:" + filename_; }
+    /**
+     * @brief 立即滚动当前文件
+     */
+    void roll();
+    /**
+     * @brief 等待已提交的压缩与清理任务完成
+     */
+    void waitIdle();
+
+    const Options& getOptions() const { return options_; }
+
+private:
+    void rollLocked(time_point now);
+    void scheduleRollLocked(time_point now);
+    std::string archiveName(time_point start) const;
+    bool isArchiveName(const std::string& name, const std::string& prefix) const;
+    // 把改名后的临时文件定名为归档并按需压缩, 在后台线程执行
+    void archive(const std::string& staged, time_point start);
+    void adoptStaged();
+    void run();
+    void compress(const std::string& path);
+    void enforceRetention();
+
+private:
+    Options options_;
+    time_point segment_start_;                  // 当前文件开始的时间
+    time_point next_roll_;                      // 下一次按时间滚动的时间
+    std::thread worker_;                        // 压缩/清理线程
+    std::mutex jobs_mutex_;
+    std::condition_variable jobs_cv_;
+    struct Job{
+        std::string staged;                     // 待归档的临时文件, 空串表示只做清理
+        time_point start;                       // 该段开始的时间
+        bool startup = false;                   // 启动时收尾遗留的临时文件
+    };
+    std::deque<Job> jobs_;
+    uint64_t roll_seq_ = 0;                     // 临时文件序号, 由 mutex_ 保护
+    bool busy_ = false;
+    bool stopping_ = false;
+};
+
+}// namespace log4cpp
+
+#endif // __ROLLING_HPP__
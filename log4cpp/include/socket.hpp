@@ -0,0 +1,141 @@
+#ifndef __SOCKET_HPP__
+#define __SOCKET_HPP__
+
+#include "log.hpp"
+
+#include <condition_variable>
+
+namespace log4cpp {
+
+/**
+ * @brief 网络/本地套接字输出器
+ * @details
+ *  支持 Unix 数据报套接字(默认 /dev/log)、UDP 与 TCP.
+ *  调用线程只在锁内把记录追加到待发送缓冲, 发送、连接与重连全部在后台线程完成, 不会阻塞记录日志的线程.
+ *  后台线程在缓冲达到 batch_bytes、距上次发送超过 interval、遇到不低于 error 的事件或 flush 时成批发送:
+ *  数据报协议用 sendmmsg 一次系统调用发出多条记录(每条记录一个数据报), TCP 用一次 sendmsg 写出整批.
+ *  对端不可用时按 reconnect_min 起、每次翻倍、不超过 reconnect_max 的间隔重连,
+ *  期间记录暂存在缓冲中, 暂存的字节数超过 spill_bytes 后丢弃新的记录并计入 getDropped().
+ *
+ *  syslog 为 true 时每条记录带 RFC 5424 报文头:
+ *   <PRI>1 TIMESTAMP HOSTNAME APP-NAME PROCID MSGID - MSG
+ *  MSGID 为日志器名称, MSG 为格式化器的输出(去掉末尾换行), 默认格式化器为 "%m";
+ *  经 TCP 发送时按 RFC 6587 在报文前加 "长度 " 分帧. 为 false 时发送格式化器的原文,
+ *  TCP 下以格式化器输出的换行分隔.
+ *
+ *  log4cpp::SocketLogAppender::Options options;
+ *  options.protocol = log4cpp::SocketLogAppender::Protocol::tcp;
+ *  options.address = "127.0.0.1";
+ *  options.port = 6514;
+ *  logger->addAppender(std::make_shared<log4cpp::SocketLogAppender>(options));
+ */
+class SocketLogAppender : public LogAppender{
+public:
+    using ptr = std::shared_ptr<SocketLogAppender>;
+
+    enum class Protocol{
+        unix_dgram = 1,
+        udp = 2,
+        tcp = 3
+    };
+
+    struct Options{
+        Protocol protocol = Protocol::unix_dgram;
+        std::string address = "/dev/log";                       // Unix 套接字路径, 或主机名/IP
+        uint16_t port = 514;                                    // udp/tcp
+        bool syslog = true;                                     // 加 RFC 5424 报文头
+        int facility = 1;                                       // syslog facility, 默认 user
+        std::string app_name;                                   // 为空时取程序名
+        size_t batch_bytes = 64 * 1024;                         // 待发送达到该字节数时发送
+        std::chrono::milliseconds interval{100};                // 距上次发送的最长时间
+        size_t spill_bytes = 4 * 1024 * 1024;                   // 对端不可用时最多暂存的字节数
+        std::chrono::milliseconds reconnect_min{100};           // 重连退避的初始间隔
+        std::chrono::milliseconds reconnect_max{10000};         // 重连退避的最长间隔
+        std::chrono::milliseconds connect_timeout{1000};        // tcp 建立连接的超时
+    };
+
+    SocketLogAppender(const Options& options);
+    ~SocketLogAppender();
+
+    void log(LogEvent::ptr event) override;
+    bool acceptsFormatted() const override { return true; }
+    void logFormatted(const LogEvent& event, std::string_view text) override;
+    /**
+     * @brief 等待后台线程对调用前的记录完成一次发送尝试; 对端不可用时记录留在缓冲中
+     */
+    void flush() override;
+    /**
+     * @brief 已连接时用非阻塞的 send 发出缓冲中的记录, 不加锁
+     */
+    void drain() override;
+    std::string getName() const override;
+    /**
+     * @brief queue_depth 为尚未发出的记录数, dropped 为暂存超限丢弃的记录数
+     */
+    void collectMetrics(LogMetrics::AppenderStats& stats) const override;
+
+    const Options& getOptions() const { return options_; }
+    bool isConnected() const { return fd_.load(std::memory_order_acquire) >= 0; }
+    uint64_t getDropped() const { return dropped_.load(std::memory_order_relaxed); }
+    /**
+     * @brief 尚未发出的字节数
+     */
+    size_t getPendingBytes() const;
+
+private:
+    // 连续存放的一批记录, 逐条记录长度以区分数据报边界
+    struct Batch{
+        LogBuffer data;
+        std::vector<uint32_t> sizes;
+        size_t index = 0;                                       // 下一条待发送的记录
+        size_t offset = 0;                                      // 下一条记录在 data 中的位置
+        size_t partial = 0;                                     // tcp 下一条记录已写出的字节数
+
+        bool done() const { return index == sizes.size(); }
+        size_t remaining() const { return data.size() - offset; }
+        void clear() { data.clear(); sizes.clear(); index = offset = partial = 0; }
+    };
+
+    void append(const LogEvent& event, std::string_view text);
+    void appendSyslogHeader(LogBuffer& buffer, const LogEvent& event);
+    void run();
+    // 发送 sending_, 全部发出时返回 true; force 为 true 时忽略重连退避
+    bool sendBatch(bool force);
+    bool connect();
+    void disconnect();
+    // 失败后按退避间隔推迟下一次连接
+    void backoff();
+    // 崩溃时用非阻塞 send 发出一批记录中未发出的部分
+    void drainBatch(int fd, const Batch& batch);
+
+private:
+    Options options_;
+    std::string hostname_;
+    std::string app_name_;
+    std::string procid_;
+    std::atomic<int> fd_{-1};
+    std::atomic<uint64_t> dropped_{0};
+    Batch batches_[2];
+
+    // 以下由 mutex_ 保护
+    Batch* pending_ = &batches_[0];                             // 调用线程追加的记录
+    size_t inflight_bytes_ = 0;                                 // sending_ 中未发出的字节数
+    size_t inflight_records_ = 0;                               // sending_ 中未发出的记录数
+    bool urgent_ = false;                                       // 有不低于 error 的记录待发送
+    uint64_t flush_seq_ = 0;                                    // flush 请求序号
+    uint64_t flushed_seq_ = 0;                                  // 已完成的 flush 序号
+    bool running_ = true;
+    std::condition_variable cv_;                                // 唤醒后台线程
+    std::condition_variable flushed_cv_;                        // 通知 flush 等待者
+
+    // 以下只由后台线程访问
+    Batch* sending_ = &batches_[1];
+    std::chrono::steady_clock::time_point retry_at_;            // 下次允许连接/重试的时间
+    std::chrono::milliseconds backoff_;
+    std::chrono::steady_clock::time_point last_send_;
+    std::thread sender_;
+};
+
+}// namespace log4cpp
+
+#endif // __SOCKET_HPP__
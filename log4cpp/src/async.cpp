@@ -0,0 +1,306 @@
+#include "async.hpp"
+
+namespace log4cpp{
+
+// 有界多生产者多消费者无锁环形队列(Vyukov)
+// 每个槽位带序号, 生产者/消费者通过 CAS 抢占位置, 不需要锁
+class RingQueue{
+public:
+    explicit RingQueue(size_t capacity){
+        size_t n = 2;
+        while(n < capacity){
+            n <<= 1;
+        }
+        mask_ = n - 1;
+        cells_.reset(new Cell[n]);
+        for(size_t i=0; i<n; ++i){
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    // 成功时取走 event, 队列满时返回 false 且 event 保持不变
+    bool tryPush(LogEvent::ptr& event){
+        Cell* cell;
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        for(;;){
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if(diff == 0){
+                if(tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(diff < 0){
+                return false;
+            }
+            else{
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+        cell->event = std::move(event);
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    bool tryPop(LogEvent::ptr& event){
+        Cell* cell;
+        size_t pos = head_.load(std::memory_order_relaxed);
+        for(;;){
+            cell = &cells_[pos & mask_];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos + 1);
+            if(diff == 0){
+                if(head_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)){
+                    break;
+                }
+            }
+            else if(diff < 0){
+                return false;
+            }
+            else{
+                pos = head_.load(std::memory_order_relaxed);
+            }
+        }
+        event = std::move(cell->event);
+        cell->seq.store(pos + mask_ + 1, std::memory_order_release);
+        return true;
+    }
+
+    size_t head() const { return head_.load(std::memory_order_acquire); }
+    size_t tail() const { return tail_.load(std::memory_order_acquire); }
+    size_t size() const {
+        size_t t = tail(), h = head();
+        return t > h ? t - h : 0;
+    }
+
+private:
+    struct Cell{
+        std::atomic<size_t> seq;
+        LogEvent::ptr event;
+    };
+
+    std::unique_ptr<Cell[]> cells_;
+    size_t mask_ = 0;
+    alignas(64) std::atomic<size_t> head_{0};
+    alignas(64) std::atomic<size_t> tail_{0};
+};
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr appender)
+    : AsyncLogAppender(appender, Options())
+{
+}
+
+AsyncLogAppender::AsyncLogAppender(LogAppender::ptr appender, const Options& options)
+    : appender_(appender), options_(options)
+{
+    if(!appender_){
+        throw std::invalid_argument("AsyncLogAppender requires an appender");
+    }
+    if(options_.workers == 0){
+        options_.workers = 1;
+    }
+    if(options_.queues < options_.workers){
+        options_.queues = options_.workers;
+    }
+    if(appender_->getFormatter()){
+        LogAppender::setFormatter(appender_->getFormatter());
+    }
+    for(size_t i=0; i<options_.queues; ++i){
+        queues_.emplace_back(new RingQueue(options_.capacity));
+    }
+    passes_.reset(new std::atomic<uint64_t>[options_.workers]);
+    for(size_t i=0; i<options_.workers; ++i){
+        passes_[i].store(0, std::memory_order_relaxed);
+    }
+    for(size_t i=0; i<options_.workers; ++i){
+        workers_.emplace_back(&AsyncLogAppender::run, this, i);
+    }
+}
+
+AsyncLogAppender::~AsyncLogAppender()
+{
+    stop();
+    appender_->flush();
+}
+
+void AsyncLogAppender::log(LogEvent::ptr event)
+{
+    static std::atomic<uint32_t> s_next_index{0};
+    thread_local uint32_t t_index = s_next_index.fetch_add(1, std::memory_order_relaxed);
+
+    RingQueue& queue = *queues_[t_index % queues_.size()];
+    if(!queue.tryPush(event)){
+        switch(options_.policy){
+        case OverflowPolicy::drop_newest:
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return;
+        case OverflowPolicy::drop_oldest:
+            do{
+                LogEvent::ptr victim;
+                if(queue.tryPop(victim)){
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                }
+            }while(!queue.tryPush(event));
+            break;
+        case OverflowPolicy::block:
+        default:
+            for(int spins = 0; !queue.tryPush(event); ++spins){
+                wakeup();
+                if(spins < 64){
+                    std::this_thread::yield();
+                }
+                else{
+                    std::this_thread::sleep_for(std::chrono::microseconds(50));
+                }
+            }
+            break;
+        }
+    }
+    wakeup();
+}
+
+void AsyncLogAppender::flush()
+{
+    if(!running_.load(std::memory_order_acquire)){
+        appender_->flush();
+        return;
+    }
+    std::vector<size_t> targets;
+    targets.reserve(queues_.size());
+    for(auto& q : queues_){
+        targets.push_back(q->tail());
+    }
+
+    flushers_.fetch_add(1, std::memory_order_seq_cst);
+    {
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        wait_cv_.notify_all();
+        // 1. 调用前入队的事件都已被取出
+        flush_cv_.wait(lock, [&]{
+            for(size_t i=0; i<queues_.size(); ++i){
+                if(queues_[i]->head() < targets[i]){
+                    return false;
+                }
+            }
+            return true;
+        });
+        // 2. 每个后台线程再完成一轮, 保证取出的事件已经写完
+        std::vector<uint64_t> passes(options_.workers);
+        for(size_t i=0; i<options_.workers; ++i){
+            passes[i] = passes_[i].load(std::memory_order_acquire);
+        }
+        flush_cv_.wait(lock, [&]{
+            for(size_t i=0; i<options_.workers; ++i){
+                if(passes_[i].load(std::memory_order_acquire) <= passes[i]){
+                    return false;
+                }
+            }
+            return true;
+        });
+    }
+    flushers_.fetch_sub(1, std::memory_order_seq_cst);
+    appender_->flush();
+}
+
+void AsyncLogAppender::setFormatter(LogFormatter::ptr val)
+{
+    LogAppender::setFormatter(val);
+    if(!appender_->getFormatter()){
+        appender_->setFormatter(val);
+    }
+}
+
+void AsyncLogAppender::collectMetrics(LogMetrics::AppenderStats& stats) const
+{
+    appender_->collectMetrics(stats);
+    stats.name = getName();
+    stats.events = metrics_.load(LogMetrics::kEvents);
+    stats.lock_wait_ns += metrics_.load(LogMetrics::kLockWaitNs);
+    stats.queue_depth = getQueueSize();
+    stats.dropped = getDropped();
+}
+
+size_t AsyncLogAppender::getQueueSize() const
+{
+    size_t size = 0;
+    for(auto& q : queues_){
+        size += q->size();
+    }
+    return size;
+}
+
+void AsyncLogAppender::run(size_t worker)
+{
+    for(;;){
+        bool busy = drain(worker);
+        passes_[worker].fetch_add(1, std::memory_order_release);
+        if(flushers_.load(std::memory_order_seq_cst) > 0){
+            std::lock_guard<std::mutex> lock(wait_mutex_);
+            flush_cv_.notify_all();
+        }
+        if(busy){
+            continue;
+        }
+        if(!running_.load(std::memory_order_acquire)){
+            break;
+        }
+
+        std::unique_lock<std::mutex> lock(wait_mutex_);
+        sleepers_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        wait_cv_.wait_for(lock, std::chrono::milliseconds(50), [&]{
+            if(!running_.load(std::memory_order_acquire) || flushers_.load(std::memory_order_acquire) > 0){
+                return true;
+            }
+            for(size_t i=worker; i<queues_.size(); i+=options_.workers){
+                if(queues_[i]->size() > 0){
+                    return true;
+                }
+            }
+            return false;
+        });
+        sleepers_.fetch_sub(1, std::memory_order_relaxed);
+    }
+}
+
+bool AsyncLogAppender::drain(size_t worker)
+{
+    bool busy = false;
+    for(size_t i=worker; i<queues_.size(); i+=options_.workers){
+        LogEvent::ptr event;
+        // 每个队列一次最多取一个容量, 避免单个队列饿死其他队列
+        for(size_t n = options_.capacity; n > 0 && queues_[i]->tryPop(event); --n){
+            appender_->log(std::move(event));
+            busy = true;
+        }
+    }
+    return busy;
+}
+
+void AsyncLogAppender::wakeup()
+{
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if(sleepers_.load(std::memory_order_relaxed) > 0){
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        wait_cv_.notify_all();
+    }
+}
+
+void AsyncLogAppender::stop()
+{
+    if(!running_.exchange(false)){
+        return;
+    }
+    {
+        std::lock_guard<std::mutex> lock(wait_mutex_);
+        wait_cv_.notify_all();
+    }
+    for(auto& t : workers_){
+        if(t.joinable()){
+            t.join();
+        }
+    }
+}
+
+} // namespace log4cpp
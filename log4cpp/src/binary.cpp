@@ -0,0 +1,317 @@
+#include "binary.hpp"
+
+#include <cstring>
+
+namespace log4cpp{
+
+namespace {
+
+template <typename T>
+void Put(LogBuffer& buffer, const T& v)
+{
+    buffer.append(reinterpret_cast<const char*>(&v), sizeof(T));
+}
+
+void PutString(LogBuffer& buffer, std::string_view str)
+{
+    Put(buffer, static_cast<uint32_t>(str.size()));
+    buffer.append(str);
+}
+
+// 按顺序读取记录字段, 越界后 ok() 为 false
+class Reader{
+public:
+    explicit Reader(std::string_view data) : data_(data) {}
+
+    template <typename T>
+    T get() {
+        T v{};
+        if(data_.size() - pos_ < sizeof(T)){
+            ok_ = false;
+            pos_ = data_.size();
+            return v;
+        }
+        std::memcpy(&v, data_.data() + pos_, sizeof(T));
+        pos_ += sizeof(T);
+        return v;
+    }
+    std::string_view getString() {
+        uint32_t len = get<uint32_t>();
+        if(data_.size() - pos_ < len){
+            ok_ = false;
+            pos_ = data_.size();
+            return std::string_view();
+        }
+        std::string_view str = data_.substr(pos_, len);
+        pos_ += len;
+        return str;
+    }
+    bool startsWith(std::string_view prefix) const {
+        return data_.substr(pos_, prefix.size()) == prefix;
+    }
+    void skip(size_t len) { pos_ = std::min(data_.size(), pos_ + len); }
+    bool ok() const { return ok_; }
+    bool done() const { return pos_ >= data_.size(); }
+    size_t pos() const { return pos_; }
+
+private:
+    std::string_view data_;
+    size_t pos_ = 0;
+    bool ok_ = true;
+};
+
+} // namespace
+
+BinaryLogAppender::BinaryLogAppender(const std::string& filename)
+    : BinaryLogAppender(filename, FlushPolicy())
+{
+}
+
+BinaryLogAppender::BinaryLogAppender(const std::string& filename, const FlushPolicy& policy)
+    : FileLogAppender(filename, policy)
+{
+    // 基类构造时调用的是 FileLogAppender::reopenLocked, 文件头在这里补上
+    std::lock_guard<std::mutex> lock(mutex_);
+    writeHeaderLocked();
+}
+
+void BinaryLogAppender::log(LogEvent::ptr event)
+{
+    auto lock = lockMetered();
+    size_t size = buffer_.size();
+    uint32_t id = siteIdLocked(*event);
+    uint32_t thread = threadIdLocked(*event);
+
+    int64_t time = LogClock::ToNanoseconds(event->getStamp());
+
+    buffer_.push_back(static_cast<char>(binary::kEventRecord));
+    Put(buffer_, id);
+    Put(buffer_, time);
+    Put(buffer_, thread);
+    buffer_.push_back(event->isBinary() ? 0 : 1);
+    PutString(buffer_, event->getContentView());
+    PutString(buffer_, event->getFields());
+
+    commitLocked(buffer_.size() - size, event->getLevel());
+}
+
+bool BinaryLogAppender::reopenLocked()
+{
+    if(!FileLogAppender::reopenLocked()){
+        return false;
+    }
+    // 缓冲中尚未写出的事件引用了已有字典, 新文件以文件头和完整字典开始
+    LogBuffer pending;
+    pending.append(buffer_.view());
+    buffer_.clear();
+    size_t size = pending.size();
+    writeHeaderLocked();
+    for(uint32_t id=0; id<sites_.size(); ++id){
+        writeSiteLocked(id);
+    }
+    for(uint32_t id=0; id<threads_.size(); ++id){
+        writeThreadLocked(id);
+    }
+    buffer_.append(pending.view());
+    file_size_ += buffer_.size() - size;
+    return true;
+}
+
+uint32_t BinaryLogAppender::siteIdLocked(const LogEvent& event)
+{
+    const Logger* logger = event.getLogger();
+    SiteKey key{event.getSite(), logger};
+    auto it = ids_.find(key);
+    // 日志器地址可能被新对象复用, 名称不同时重新登记
+    if(it != ids_.end() && (!logger || sites_[it->second].logger == logger->getName())){
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(sites_.size());
+    sites_.push_back({event.getSite(), logger ? logger->getName() : std::string()});
+    ids_[key] = id;
+    writeSiteLocked(id);
+    return id;
+}
+
+uint32_t BinaryLogAppender::threadIdLocked(const LogEvent& event)
+{
+    uint64_t key = static_cast<uint64_t>(event.getThreadId()) << 32 | event.getFiberId();
+    std::string_view name = event.getThreadName();
+    auto it = thread_ids_.find(key);
+    // 线程id可能被新线程复用, 线程也可能改名, 名称不同时重新登记
+    if(it != thread_ids_.end() && threads_[it->second].name == name){
+        return it->second;
+    }
+    uint32_t id = static_cast<uint32_t>(threads_.size());
+    threads_.push_back({event.getThreadId(), event.getFiberId(), std::string(name)});
+    thread_ids_[key] = id;
+    writeThreadLocked(id);
+    return id;
+}
+
+void BinaryLogAppender::writeHeaderLocked()
+{
+    buffer_.append(binary::kMagic, sizeof(binary::kMagic));
+    Put(buffer_, binary::kVersion);
+    Put(buffer_, LogClock::StartNanoseconds());
+}
+
+void BinaryLogAppender::writeThreadLocked(uint32_t id)
+{
+    const ThreadEntry& entry = threads_[id];
+    buffer_.push_back(static_cast<char>(binary::kThreadRecord));
+    Put(buffer_, id);
+    Put(buffer_, static_cast<uint64_t>(entry.tid));
+    Put(buffer_, entry.fiber_id);
+    PutString(buffer_, entry.name);
+}
+
+void BinaryLogAppender::writeSiteLocked(uint32_t id)
+{
+    const SiteEntry& entry = sites_[id];
+    const LogSite* site = entry.site;
+    buffer_.push_back(static_cast<char>(binary::kSiteRecord));
+    Put(buffer_, id);
+    Put(buffer_, static_cast<uint8_t>(site->level));
+    Put(buffer_, site->line);
+    PutString(buffer_, site->file ? site->file : "");
+    PutString(buffer_, site->func ? site->func : "");
+    PutString(buffer_, site->fmt ? site->fmt : "");
+    PutString(buffer_, entry.logger);
+}
+
+BinaryLogDecoder::BinaryLogDecoder(LogFormatter::ptr formatter)
+    : formatter_(formatter)
+{
+}
+
+bool BinaryLogDecoder::decodeFile(const std::string& filename, std::ostream& os)
+{
+    std::ifstream in(filename, std::ios::binary);
+    if(!in){
+        error_ = "cannot open " + filename;
+        return false;
+    }
+    std::string data((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    return decode(data, os);
+}
+
+bool BinaryLogDecoder::decode(std::string_view data, std::ostream& os)
+{
+    Reader reader(data);
+    LogBuffer out;
+    bool header = false;
+    int64_t start = 0;
+    while(!reader.done()){
+        size_t offset = reader.pos();
+        if(reader.startsWith(std::string_view(binary::kMagic, sizeof(binary::kMagic)))){
+            reader.skip(sizeof(binary::kMagic));
+            uint32_t version = reader.get<uint32_t>();
+            if(version != binary::kVersion){
+                error_ = "unsupported version " + std::to_string(version);
+                return false;
+            }
+            start = reader.get<int64_t>();
+            sites_.clear();
+            threads_.clear();
+            header = true;
+            continue;
+        }
+        uint8_t type = reader.get<uint8_t>();
+        if(!header){
+            error_ = "missing file header";
+            return false;
+        }
+        if(type == binary::kSiteRecord){
+            auto site = std::make_unique<Site>();
+            uint32_t id = reader.get<uint32_t>();
+            site->site.level = static_cast<LogLevel::Level>(reader.get<uint8_t>());
+            site->site.line = reader.get<int32_t>();
+            site->file = reader.getString();
+            site->func = reader.getString();
+            site->fmt = reader.getString();
+            site->logger = getLogger(std::string(reader.getString()));
+            site->site.file = site->file.c_str();
+            site->site.func = site->func.c_str();
+            site->site.fmt = site->fmt.c_str();
+            if(reader.ok()){
+                sites_[id] = std::move(site);
+            }
+        }
+        else if(type == binary::kThreadRecord){
+            uint32_t id = reader.get<uint32_t>();
+            Thread thread;
+            thread.tid = static_cast<uint32_t>(reader.get<uint64_t>());
+            thread.fiber_id = reader.get<uint32_t>();
+            thread.name = reader.getString();
+            if(reader.ok()){
+                threads_[id] = std::move(thread);
+            }
+        }
+        else if(type == binary::kEventRecord){
+            uint32_t id = reader.get<uint32_t>();
+            int64_t time = reader.get<int64_t>();
+            uint32_t thread = reader.get<uint32_t>();
+            uint8_t text = reader.get<uint8_t>();
+            std::string_view content = reader.getString();
+            std::string_view fields = reader.getString();
+            if(!reader.ok()){
+                break;
+            }
+            auto it = sites_.find(id);
+            if(it == sites_.end()){
+                error_ = "unknown site id " + std::to_string(id) + " at offset " + std::to_string(offset);
+                return false;
+            }
+            auto tit = threads_.find(thread);
+            if(tit == threads_.end()){
+                error_ = "unknown thread id " + std::to_string(thread) + " at offset " + std::to_string(offset);
+                return false;
+            }
+            uint32_t elapse = static_cast<uint32_t>(std::max<int64_t>(time - start, 0) / 1000000);
+            time_point tp(std::chrono::duration_cast<time_point::duration>(std::chrono::nanoseconds(time)));
+            LogEvent event(it->second->logger.get(), &it->second->site, elapse,
+                    tit->second.tid, tit->second.fiber_id, tp, tit->second.name);
+            event.setFields(fields);
+            if(text){
+                event.getContentStream() << content;
+            }
+            else{
+                event.setBinaryContent(content);
+                event.materialize();
+            }
+            formatter_->format(out, event);
+            if(out.size() >= 64 * 1024){
+                os.write(out.data(), static_cast<std::streamsize>(out.size()));
+                out.clear();
+            }
+        }
+        else{
+            error_ = "unknown record type " + std::to_string(type) + " at offset " + std::to_string(offset);
+            return false;
+        }
+        if(!reader.ok()){
+            break;
+        }
+    }
+    os.write(out.data(), static_cast<std::streamsize>(out.size()));
+    // 进程崩溃时文件末尾可能是半条记录, 已解码的部分照常输出
+    if(!reader.ok()){
+        error_ = "truncated record";
+        return false;
+    }
+    return true;
+}
+
+Logger::ptr BinaryLogDecoder::getLogger(const std::string& name)
+{
+    auto it = loggers_.find(name);
+    if(it != loggers_.end()){
+        return it->second;
+    }
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, name);
+    loggers_[name] = logger;
+    return logger;
+}
+
+} // namespace log4cpp
@@ -0,0 +1,606 @@
+#include "config.hpp"
+#include "async.hpp"
+#include "rolling.hpp"
+#include "binary.hpp"
+#include "socket.hpp"
+
+#include <filesystem>
+#include <set>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <sys/inotify.h>
+
+namespace log4cpp{
+
+namespace fs = std::filesystem;
+
+namespace {
+
+std::string_view Trim(std::string_view str)
+{
+    size_t begin = str.find_first_not_of(" \t\r");
+    if(begin == std::string_view::npos){
+        return std::string_view();
+    }
+    size_t end = str.find_last_not_of(" \t\r");
+    return str.substr(begin, end - begin + 1);
+}
+
+// 去掉以空白开头的 ';' 或 '#' 之后的注释
+std::string_view StripComment(std::string_view str)
+{
+    for(size_t i=1; i<str.size(); ++i){
+        if((str[i] == ';' || str[i] == '#') && (str[i-1] == ' ' || str[i-1] == '\t')){
+            return str.substr(0, i);
+        }
+    }
+    return str;
+}
+
+std::vector<std::string> SplitList(std::string_view str)
+{
+    std::vector<std::string> items;
+    while(!str.empty()){
+        size_t pos = str.find(',');
+        std::string_view item = Trim(str.substr(0, pos));
+        if(!item.empty()){
+            items.emplace_back(item);
+        }
+        if(pos == std::string_view::npos){
+            break;
+        }
+        str.remove_prefix(pos + 1);
+    }
+    return items;
+}
+
+bool ParseBool(std::string_view str, bool& value)
+{
+    if(str == "true" || str == "yes" || str == "on" || str == "1"){
+        value = true;
+        return true;
+    }
+    if(str == "false" || str == "no" || str == "off" || str == "0"){
+        value = false;
+        return true;
+    }
+    return false;
+}
+
+// 非负整数, 可带 K/M/G 后缀(1024 进制)
+bool ParseSize(std::string_view str, uint64_t& value)
+{
+    uint64_t scale = 1;
+    if(!str.empty()){
+        switch(str.back()){
+        case 'K': case 'k': scale = 1ull << 10; break;
+        case 'M': case 'm': scale = 1ull << 20; break;
+        case 'G': case 'g': scale = 1ull << 30; break;
+        }
+        if(scale != 1){
+            str.remove_suffix(1);
+        }
+    }
+    auto r = std::from_chars(str.data(), str.data() + str.size(), value);
+    if(str.empty() || r.ec != std::errc() || r.ptr != str.data() + str.size()){
+        return false;
+    }
+    value *= scale;
+    return true;
+}
+
+// 带符号的整数, 用于可以取负数的毫秒数
+bool ParseInt(std::string_view str, int64_t& value)
+{
+    auto r = std::from_chars(str.data(), str.data() + str.size(), value);
+    return !str.empty() && r.ec == std::errc() && r.ptr == str.data() + str.size();
+}
+
+bool ParseLevel(std::string_view str, LogLevel::Level& level)
+{
+    level = LogLevel::FromString(str);
+    return level != LogLevel::Level::unknow;
+}
+
+std::string AtLine(int line)
+{
+    return "line " + std::to_string(line) + ": ";
+}
+
+// 按输出器配置创建输出器, 选项的合法性全部在这里检查
+class AppenderBuilder{
+public:
+    explicit AppenderBuilder(const LogConfig::AppenderEntry& entry) : entry_(entry) {}
+
+    /**
+     * @brief 只检查选项, 不创建输出器(不打开文件、不启动线程、不连接)
+     */
+    bool check(std::string& error) {
+        create_ = false;
+        build(error);
+        return error.empty();
+    }
+
+    LogAppender::ptr build(std::string& error) {
+        std::string type = get("type");
+        LogAppender::ptr appender;
+        if(type == "stdout" || type == "stderr"){
+            StdoutLogAppender::Options options;
+            options.target = type == "stdout" ? StdoutLogAppender::Target::out : StdoutLogAppender::Target::err;
+            getBool("color", options.color);
+            if(error_.empty() && create_){
+                appender = std::make_shared<StdoutLogAppender>(options);
+            }
+        }
+        else if(type == "file" || type == "binary" || type == "rolling"){
+            std::string file = get("file");
+            if(file.empty()){
+                fail("missing 'file'");
+            }
+            FileLogAppender::FlushPolicy flush;
+            uint64_t bytes = flush.bytes;
+            int64_t interval = flush.interval.count();
+            getSize("flush_bytes", bytes);
+            getInt("flush_interval", interval);
+            flush.bytes = bytes;
+            flush.interval = std::chrono::milliseconds(interval);
+            if(type == "rolling"){
+                RollingFileAppender::Options options;
+                options.flush = flush;
+                uint64_t files = 0;
+                uint64_t seconds = 0;
+                getSize("max_bytes", options.max_bytes);
+                getSize("max_files", files);
+                getSize("interval", seconds);
+                options.max_files = files;
+                options.interval = std::chrono::seconds(seconds);
+                std::string compress = get("compress", "gzip");
+                if(compress != "gzip" && compress != "none"){
+                    fail("invalid 'compress' value '" + compress + "'");
+                }
+                options.compression = compress == "gzip" ? RollingFileAppender::Compression::gzip
+                                                         : RollingFileAppender::Compression::none;
+                if(error_.empty() && create_){
+                    appender = std::make_shared<RollingFileAppender>(file, options);
+                }
+            }
+            else if(error_.empty() && create_){
+                appender = type == "binary" ? std::make_shared<BinaryLogAppender>(file, flush)
+                                            : std::make_shared<FileLogAppender>(file, flush);
+            }
+        }
+        else if(type == "syslog" || type == "udp" || type == "tcp"){
+            SocketLogAppender::Options options;
+            if(type == "syslog"){
+                options.address = get("address", options.address);
+            }
+            else{
+                options.protocol = type == "udp" ? SocketLogAppender::Protocol::udp : SocketLogAppender::Protocol::tcp;
+                options.address = get("address");
+                if(options.address.empty()){
+                    fail("missing 'address'");
+                }
+                uint64_t port = options.port;
+                getSize("port", port);
+                if(port == 0 || port > 65535){
+                    fail("invalid port " + std::to_string(port));
+                }
+                options.port = static_cast<uint16_t>(port);
+            }
+            getBool("syslog", options.syslog);
+            uint64_t bytes = options.batch_bytes;
+            int64_t interval = options.interval.count();
+            uint64_t spill = options.spill_bytes;
+            getSize("flush_bytes", bytes);
+            getInt("flush_interval", interval);
+            getSize("spill_bytes", spill);
+            if(interval < 0){
+                fail("invalid 'flush_interval' " + std::to_string(interval) + " for type '" + type + "'");
+            }
+            options.batch_bytes = bytes;
+            options.interval = std::chrono::milliseconds(interval);
+            options.spill_bytes = spill;
+            if(error_.empty() && create_){
+                appender = std::make_shared<SocketLogAppender>(options);
+            }
+        }
+        else{
+            fail("unknown type '" + type + "'");
+        }
+
+        std::string pattern = get("pattern");
+        if(!pattern.empty()){
+            auto formatter = std::make_shared<LogFormatter>(pattern);
+            if(formatter->isError()){
+                fail("invalid pattern '" + pattern + "'");
+            }
+            else if(appender){
+                appender->setFormatter(formatter);
+            }
+        }
+        bool async = false;
+        getBool("async", async);
+        uint64_t capacity = AsyncLogAppender::Options().capacity;
+        getSize("queue_capacity", capacity);
+        for(auto& i : entry_.options){
+            if(!used_.count(i.first)){
+                fail("unknown key '" + i.first + "' for type '" + type + "'");
+            }
+        }
+        if(!error_.empty()){
+            error = AtLine(entry_.line) + "appender '" + entry_.name + "': " + error_;
+            return nullptr;
+        }
+        if(async && appender){
+            AsyncLogAppender::Options options;
+            options.capacity = capacity;
+            appender = std::make_shared<AsyncLogAppender>(appender, options);
+        }
+        return appender;
+    }
+
+private:
+    std::string get(const std::string& key, const std::string& def = "") {
+        used_.insert(key);
+        auto it = entry_.options.find(key);
+        return it == entry_.options.end() ? def : it->second;
+    }
+    void getBool(const std::string& key, bool& value) {
+        std::string str = get(key);
+        if(!str.empty() && !ParseBool(str, value)){
+            fail("invalid boolean '" + str + "' for '" + key + "'");
+        }
+    }
+    void getSize(const std::string& key, uint64_t& value) {
+        std::string str = get(key);
+        if(!str.empty() && !ParseSize(str, value)){
+            fail("invalid number '" + str + "' for '" + key + "'");
+        }
+    }
+    void getInt(const std::string& key, int64_t& value) {
+        std::string str = get(key);
+        if(!str.empty() && !ParseInt(str, value)){
+            fail("invalid number '" + str + "' for '" + key + "'");
+        }
+    }
+    void fail(const std::string& error) {
+        if(error_.empty()){
+            error_ = error;
+        }
+    }
+
+private:
+    const LogConfig::AppenderEntry& entry_;
+    std::set<std::string> used_;
+    std::string error_;
+    bool create_ = true;
+};
+
+} // namespace
+
+bool LogConfig::Parse(std::string_view text, LogConfig& config, std::string& error)
+{
+    config = LogConfig();
+    AppenderEntry* appender = nullptr;
+    LoggerEntry* logger = nullptr;
+    std::set<std::string> sections;
+    int line_no = 0;
+    while(!text.empty()){
+        size_t pos = text.find('\n');
+        std::string_view line = text.substr(0, pos);
+        text.remove_prefix(pos == std::string_view::npos ? text.size() : pos + 1);
+        ++line_no;
+
+        line = Trim(line);
+        if(line.empty() || line[0] == '#' || line[0] == ';'){
+            continue;
+        }
+        line = Trim(StripComment(line));
+        if(line.front() == '['){
+            if(line.back() != ']'){
+                error = AtLine(line_no) + "unterminated section header";
+                return false;
+            }
+            std::string section(Trim(line.substr(1, line.size() - 2)));
+            if(!sections.insert(section).second){
+                error = AtLine(line_no) + "duplicate section [" + section + "]";
+                return false;
+            }
+            appender = nullptr;
+            logger = nullptr;
+            if(section.compare(0, 9, "appender.") == 0 && section.size() > 9){
+                config.appenders.push_back({section.substr(9), {}, line_no});
+                appender = &config.appenders.back();
+            }
+            else if(section.compare(0, 7, "logger.") == 0 && section.size() > 7){
+                config.loggers.emplace_back();
+                logger = &config.loggers.back();
+                logger->name = section.substr(7);
+                logger->line = line_no;
+            }
+            else{
+                error = AtLine(line_no) + "unknown section [" + section + "]";
+                return false;
+            }
+            continue;
+        }
+
+        size_t eq = line.find('=');
+        if(eq == std::string_view::npos){
+            error = AtLine(line_no) + "expected 'key = value'";
+            return false;
+        }
+        std::string key(Trim(line.substr(0, eq)));
+        std::string value(Trim(line.substr(eq + 1)));
+        if(appender){
+            appender->options[key] = value;
+        }
+        else if(logger){
+            if(key == "level"){
+                LogLevel::Level level;
+                if(!value.empty() && !ParseLevel(value, level)){
+                    error = AtLine(line_no) + "invalid level '" + value + "'";
+                    return false;
+                }
+                logger->level = value.empty() ? std::nullopt : std::optional<LogLevel::Level>(level);
+            }
+            else if(key == "additivity"){
+                if(!ParseBool(value, logger->additive)){
+                    error = AtLine(line_no) + "invalid boolean '" + value + "'";
+                    return false;
+                }
+            }
+            else if(key == "pattern"){
+                logger->pattern = value;
+            }
+            else if(key == "appenders"){
+                logger->appenders = SplitList(value);
+            }
+            else{
+                error = AtLine(line_no) + "unknown key '" + key + "' for logger '" + logger->name + "'";
+                return false;
+            }
+        }
+        else{
+            error = AtLine(line_no) + "key outside of a section";
+            return false;
+        }
+    }
+    return true;
+}
+
+ConfigLoader::ConfigLoader(const std::string& path)
+    : path_(path)
+{
+}
+
+ConfigLoader::~ConfigLoader()
+{
+    stop();
+}
+
+bool ConfigLoader::load()
+{
+    std::ifstream in(path_, std::ios::binary);
+    if(!in){
+        setError("cannot open " + path_);
+        return false;
+    }
+    std::string text((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+    LogConfig config;
+    std::string error;
+    if(!LogConfig::Parse(text, config, error)){
+        setError(error);
+        return false;
+    }
+    return apply(config);
+}
+
+bool ConfigLoader::apply(const LogConfig& config)
+{
+    std::lock_guard<std::mutex> lock(apply_mutex_);
+
+    // 先检查全部输出器的选项与日志器的模板、引用, 出错时不创建任何输出器, 也不改动任何日志器
+    std::set<std::string> defined;
+    for(auto& entry : config.appenders){
+        std::string error;
+        if(!AppenderBuilder(entry).check(error)){
+            setError(error);
+            return false;
+        }
+        defined.insert(entry.name);
+    }
+    struct Target{
+        const LogConfig::LoggerEntry* entry;
+        Logger::ptr logger;
+        LogFormatter::ptr formatter;
+        std::vector<LogAppender::ptr> appenders;
+    };
+    std::vector<Target> targets;
+    std::set<std::string> names;
+    for(auto& entry : config.loggers){
+        Target target{&entry, nullptr, nullptr, {}};
+        if(!entry.pattern.empty()){
+            target.formatter = std::make_shared<LogFormatter>(entry.pattern);
+            if(target.formatter->isError()){
+                setError(AtLine(entry.line) + "logger '" + entry.name + "': invalid pattern '" + entry.pattern + "'");
+                return false;
+            }
+        }
+        for(auto& name : entry.appenders){
+            if(!defined.count(name)){
+                setError(AtLine(entry.line) + "logger '" + entry.name + "': unknown appender '" + name + "'");
+                return false;
+            }
+        }
+        targets.push_back(std::move(target));
+        names.insert(entry.name);
+    }
+
+    // 节内容与上一次相同的输出器沿用原对象, 保留其缓冲、文件位置与连接
+    std::map<std::string, Loaded> appenders;
+    std::set<LogAppender*> inherit;                 // 没有自己的模板, 使用第一个引用它的日志器的模板
+    for(auto& entry : config.appenders){
+        auto it = appenders_.find(entry.name);
+        if(it != appenders_.end() && it->second.options == entry.options){
+            appenders[entry.name] = it->second;
+        }
+        else{
+            std::string error;
+            LogAppender::ptr appender = AppenderBuilder(entry).build(error);
+            if(!appender){
+                setError(error);
+                return false;
+            }
+            appenders[entry.name] = {entry.options, appender};
+        }
+        if(!entry.options.count("pattern")){
+            inherit.insert(appenders[entry.name].appender.get());
+        }
+    }
+    for(auto& target : targets){
+        for(auto& name : target.entry->appenders){
+            const LogAppender::ptr& appender = appenders[name].appender;
+            if(std::find(target.appenders.begin(), target.appenders.end(), appender) == target.appenders.end()){
+                target.appenders.push_back(appender);
+            }
+        }
+    }
+
+    LoggerManager& manager = LoggerManager::getInstance();
+    for(auto& target : targets){
+        target.logger = manager.getLogger(target.entry->name);
+    }
+    std::vector<Logger::ptr> resets;
+    for(auto& name : configured_){
+        if(!names.count(name)){
+            resets.push_back(manager.getLogger(name));
+        }
+    }
+
+    // 在层级锁内改完所有日志器, 再从 root 起统一重新发布快照
+    {
+        std::lock_guard<std::mutex> hierarchy(Logger::HierarchyMutex());
+        for(auto& logger : resets){
+            if(logger->parent_){
+                logger->level_set_ = false;
+            }
+            logger->additive_ = true;
+            logger->appenders_.clear();
+        }
+        for(auto& target : targets){
+            Logger& logger = *target.logger;
+            const LogConfig::LoggerEntry& entry = *target.entry;
+            if(target.formatter){
+                logger.formatter_ = target.formatter;
+            }
+            if(entry.level){
+                logger.level_ = *entry.level;
+                logger.level_set_ = true;
+            }
+            else if(logger.parent_){
+                logger.level_set_ = false;
+            }
+            logger.additive_ = entry.additive;
+            for(auto& appender : target.appenders){
+                if(inherit.erase(appender.get())){
+                    appender->setFormatter(logger.formatter_);
+                }
+            }
+            logger.appenders_ = target.appenders;
+        }
+        manager.getRoot()->updateLocked();
+    }
+
+    configured_.assign(names.begin(), names.end());
+    appenders_ = std::move(appenders);
+    setError("");
+    generation_.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+bool ConfigLoader::watch()
+{
+    if(watcher_.joinable()){
+        return true;
+    }
+    fs::path path(path_);
+    std::string dir = path.has_parent_path() ? path.parent_path().string() : std::string(".");
+    inotify_fd_ = ::inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    stop_fd_ = ::eventfd(0, EFD_CLOEXEC);
+    // 监视目录而不是文件本身, 编辑器以 rename 方式保存后仍能收到通知
+    if(inotify_fd_ < 0 || stop_fd_ < 0
+            || ::inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO) < 0){
+        setError("cannot watch " + dir + ": " + std::strerror(errno));
+        stop();
+        return false;
+    }
+    watcher_ = std::thread(&ConfigLoader::run, this);
+    return true;
+}
+
+void ConfigLoader::stop()
+{
+    if(watcher_.joinable()){
+        uint64_t one = 1;
+        ssize_t n = ::write(stop_fd_, &one, sizeof(one));
+        (void)n;
+        watcher_.join();
+    }
+    if(inotify_fd_ >= 0){
+        ::close(inotify_fd_);
+        inotify_fd_ = -1;
+    }
+    if(stop_fd_ >= 0){
+        ::close(stop_fd_);
+        stop_fd_ = -1;
+    }
+}
+
+void ConfigLoader::run()
+{
+    setThreadName("log4cpp-config");
+    std::string filename = fs::path(path_).filename().string();
+    alignas(inotify_event) char buffer[4096];
+    pollfd fds[2] = {{inotify_fd_, POLLIN, 0}, {stop_fd_, POLLIN, 0}};
+    for(;;){
+        if(::poll(fds, 2, -1) < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        if(fds[1].revents){
+            break;
+        }
+        bool changed = false;
+        ssize_t n;
+        while((n = ::read(inotify_fd_, buffer, sizeof(buffer))) > 0){
+            for(char* p = buffer; p < buffer + n; ){
+                auto* event = reinterpret_cast<inotify_event*>(p);
+                if(event->len > 0 && filename == event->name){
+                    changed = true;
+                }
+                p += sizeof(inotify_event) + event->len;
+            }
+        }
+        if(changed && !load()){
+            std::cout << "ConfigLoader[" << path_ << "] reload error: " << getError() << std::endl;
+        }
+    }
+}
+
+std::string ConfigLoader::getError() const
+{
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    return error_;
+}
+
+void ConfigLoader::setError(const std::string& error)
+{
+    std::lock_guard<std::mutex> lock(error_mutex_);
+    error_ = error;
+}
+
+} // namespace log4cpp
@@ -0,0 +1,120 @@
+#include "crash.hpp"
+
+#include <csignal>
+#include <cstdlib>
+#include <exception>
+#include <unistd.h>
+
+namespace log4cpp{
+
+namespace {
+
+constexpr size_t kMaxAppenders = 256;
+constexpr int kSignals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+
+// 已登记的输出器, 空位为 nullptr; 超过容量的输出器不登记
+std::atomic<LogAppender*> s_appenders[kMaxAppenders];
+std::atomic<bool> s_installed{false};
+std::atomic<bool> s_drained{false};
+struct sigaction s_old_actions[std::size(kSignals)];
+std::terminate_handler s_old_terminate = nullptr;
+
+void WriteStderr(const char* str)
+{
+    ssize_t n = ::write(STDERR_FILENO, str, std::strlen(str));
+    (void)n;
+}
+
+const char* SignalName(int sig)
+{
+    switch(sig){
+    case SIGSEGV: return "SIGSEGV";
+    case SIGABRT: return "SIGABRT";
+    case SIGBUS: return "SIGBUS";
+    case SIGFPE: return "SIGFPE";
+    case SIGILL: return "SIGILL";
+    default: return "signal";
+    }
+}
+
+void HandleSignal(int sig)
+{
+    WriteStderr("log4cpp: caught ");
+    WriteStderr(SignalName(sig));
+    WriteStderr(", draining log buffers\n");
+    CrashHandler::Drain();
+    // 恢复原来的处理方式后重新触发, 保留默认的终止行为
+    for(size_t i=0; i<std::size(kSignals); ++i){
+        if(kSignals[i] == sig){
+            ::sigaction(sig, &s_old_actions[i], nullptr);
+        }
+    }
+    ::raise(sig);
+}
+
+void HandleTerminate()
+{
+    WriteStderr("log4cpp: std::terminate called, draining log buffers\n");
+    CrashHandler::Drain();
+    if(s_old_terminate){
+        s_old_terminate();
+    }
+    std::abort();
+}
+
+} // namespace
+
+void CrashHandler::Install()
+{
+    if(s_installed.exchange(true)){
+        return;
+    }
+    static constexpr size_t kAltStackSize = 64 * 1024;
+    stack_t stack{};
+    stack.ss_sp = new char[kAltStackSize];
+    stack.ss_size = kAltStackSize;
+    ::sigaltstack(&stack, nullptr);
+
+    struct sigaction action{};
+    action.sa_handler = HandleSignal;
+    action.sa_flags = SA_ONSTACK;
+    sigemptyset(&action.sa_mask);
+    for(size_t i=0; i<std::size(kSignals); ++i){
+        ::sigaction(kSignals[i], &action, &s_old_actions[i]);
+    }
+    s_old_terminate = std::set_terminate(HandleTerminate);
+}
+
+void CrashHandler::Drain()
+{
+    if(s_drained.exchange(true)){
+        return;
+    }
+    for(auto& slot : s_appenders){
+        if(LogAppender* appender = slot.load(std::memory_order_acquire)){
+            appender->drain();
+        }
+    }
+}
+
+void CrashHandler::Register(LogAppender* appender)
+{
+    for(auto& slot : s_appenders){
+        LogAppender* expected = nullptr;
+        if(slot.compare_exchange_strong(expected, appender, std::memory_order_acq_rel)){
+            return;
+        }
+    }
+}
+
+void CrashHandler::Unregister(LogAppender* appender)
+{
+    for(auto& slot : s_appenders){
+        LogAppender* expected = appender;
+        if(slot.compare_exchange_strong(expected, nullptr, std::memory_order_acq_rel)){
+            return;
+        }
+    }
+}
+
+} // namespace log4cpp
@@ -1,4 +1,24 @@
 #include "log.hpp"
+#include "crash.hpp"
+
+#include <algorithm>
+#include <functional>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
 
 namespace log4cpp{
 
@@ -18,545 +38,2080 @@ const char * LogLevel::ToString(LogLevel::Level level)
     }
 }
 
-LogLevel::Level LogLevel::FromString(const std::string &str)
+void LogBuffer::grow(size_t len)
 {
-#define XX(level, v) \
-    if(str == #v)\
-        return LogLevel::Level::level;
-    XX(debug, debug)
-    XX(info, info)
-    XX(warn, warn)
-    XX(error, error)
-    XX(fatal, fatal)
-    XX(debug, DEBUG)
-    XX(info, INFO)
-    XX(warn, WARN)
-    XX(error, ERROR)
-    XX(fatal, FATAL)
-    return LogLevel::Level::unknow;
-#undef XX
+    size_t capacity = std::max(capacity_ * 2, size_ + len);
+    char* data = new char[capacity];
+    std::memcpy(data, data_, size_);
+    release();
+    data_ = data;
+    capacity_ = capacity;
+}
+
+void LogBuffer::release()
+{
+    if(data_ != inline_){
+        delete[] data_;
+        data_ = inline_;
+        capacity_ = kInlineSize;
+    }
+}
+
+void LogBuffer::shrink(size_t limit)
+{
+    size_ = 0;
+    if(capacity_ > limit){
+        release();
+    }
+}
+
+LogStreamBuf::int_type LogStreamBuf::overflow(int_type c)
+{
+    if(!traits_type::eq_int_type(c, traits_type::eof())){
+        buffer_.push_back(traits_type::to_char_type(c));
+    }
+    return traits_type::not_eof(c);
+}
+
+std::streamsize LogStreamBuf::xsputn(const char* str, std::streamsize len)
+{
+    buffer_.append(str, static_cast<size_t>(len));
+    return len;
+}
+
+void LogStream::reset()
+{
+    // 过长消息撑大的缓冲不随对象池长期占用
+    buffer_.shrink(64 * 1024);
+    clear();
+    flags(std::ios_base::skipws | std::ios_base::dec);
+    precision(6);
+    width(0);
+    fill(' ');
+}
+
+LogFormatter::LogFormatter(const std::string &pattern) : pattern_(pattern)
+{
+    init();
+}
+
+// %x  %x{xxx}  %%
+void LogFormatter::init()
+{
+    ops_.clear();
+    text_.clear();
+    bool last_literal = false;
+    error_ = !Parse(pattern_, [&](OpCode code, std::string_view str){
+        bool literal = code == OpCode::literal;
+        // 相邻的字面文本在文本区中也相邻, 直接合并成一条指令
+        if(literal && last_literal){
+            ops_.back().length += str.size();
+        }
+        else{
+            ops_.push_back(Op{code, static_cast<uint32_t>(text_.size()), static_cast<uint32_t>(str.size())});
+        }
+        text_.append(str);
+        if(code == OpCode::datetime){
+            text_.push_back('\0');
+        }
+        last_literal = literal;
+    });
+    if(error_){
+        std::cout << "pattern pharse error: " << pattern_ << std::endl;
+    }
+}
+
+void LogFormatter::format(LogBuffer& buffer, const LogEvent& event) const
+{
+    const char* text = text_.data();
+    for(const Op& op : ops_){
+        Execute(op, text, event, buffer);
+    }
+}
+
+std::string LogFormatter::format(LogEvent::ptr event)
+{
+    LogBuffer buffer;
+    format(buffer, *event);
+    return std::string(buffer.view());
+}
+
+std::ostream &LogFormatter::format(std::ostream &os, LogEvent::ptr event)
+{
+    thread_local LogBuffer t_buffer;
+    t_buffer.clear();
+    format(t_buffer, *event);
+    return os.write(t_buffer.data(), t_buffer.size());
+}
+
+void LogFormatter::AppendLoggerName(LogBuffer& buffer, const LogEvent& event)
+{
+    buffer.append(event.getLogger()->getName());
+}
+
+namespace {
+
+bool NeedsJsonEscape(unsigned char c)
+{
+    return c < 0x20 || c == '"' || c == '\\';
+}
+
+void EscapeJsonChar(LogBuffer& buffer, unsigned char c)
+{
+    static constexpr char kHex[] = "0123456789abcdef";
+    char* p = buffer.prepare(6);
+    p[0] = '\\';
+    switch(c){
+    case '"':  p[1] = '"';  break;
+    case '\\': p[1] = '\\'; break;
+    case '\n': p[1] = 'n';  break;
+    case '\r': p[1] = 'r';  break;
+    case '\t': p[1] = 't';  break;
+    case '\b': p[1] = 'b';  break;
+    case '\f': p[1] = 'f';  break;
+    default:
+        p[1] = 'u';
+        p[2] = '0';
+        p[3] = '0';
+        p[4] = kHex[c >> 4];
+        p[5] = kHex[c & 0xf];
+        buffer.commit(6);
+        return;
+    }
+    buffer.commit(2);
+}
+
+} // namespace
+
+void LogFormatter::AppendJsonString(LogBuffer& buffer, std::string_view str)
+{
+    buffer.push_back('"');
+    const char* p = str.data();
+    const char* end = p + str.size();
+    const char* begin = p;                  // 尚未拷贝的片段起点
+#if defined(__SSE2__)
+    const __m128i quote = _mm_set1_epi8('"');
+    const __m128i backslash = _mm_set1_epi8('\\');
+    const __m128i control = _mm_set1_epi8(0x1f);
+    while(end - p >= 16){
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        // min(v, 0x1f) == v 即 v <= 0x1f(无符号比较)
+        __m128i m = _mm_or_si128(_mm_or_si128(_mm_cmpeq_epi8(v, quote), _mm_cmpeq_epi8(v, backslash)),
+                _mm_cmpeq_epi8(_mm_min_epu8(v, control), v));
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(m));
+        if(mask == 0){
+            p += 16;
+            continue;
+        }
+        p += __builtin_ctz(mask);
+        buffer.append(begin, p - begin);
+        EscapeJsonChar(buffer, static_cast<unsigned char>(*p));
+        begin = ++p;
+    }
+#endif
+    for(; p < end; ++p){
+        if(NeedsJsonEscape(static_cast<unsigned char>(*p))){
+            buffer.append(begin, p - begin);
+            EscapeJsonChar(buffer, static_cast<unsigned char>(*p));
+            begin = p + 1;
+        }
+    }
+    buffer.append(begin, end - begin);
+    buffer.push_back('"');
+}
+
+namespace {
+
+// 1970-01-01 起的天数 -> 公历年月日
+void CivilFromDays(int64_t days, int& year, int& month, int& day)
+{
+    days += 719468;
+    int64_t era = (days >= 0 ? days : days - 146096) / 146097;
+    int64_t doe = days - era * 146097;
+    int64_t yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;
+    int64_t doy = doe - (365 * yoe + yoe / 4 - yoe / 100);
+    int64_t mp = (5 * doy + 2) / 153;
+    day = static_cast<int>(doy - (153 * mp + 2) / 5 + 1);
+    month = static_cast<int>(mp < 10 ? mp + 3 : mp - 9);
+    year = static_cast<int>(yoe + era * 400 + (month <= 2));
+}
+
+int64_t FloorDiv(int64_t a, int64_t b)
+{
+    return a / b - ((a % b != 0) && ((a < 0) != (b < 0)));
+}
+
+// 不经过时区转换的 UTC 分解时间
+void UtcTime(int64_t seconds, std::tm& tm)
+{
+    int64_t days = FloorDiv(seconds, 86400);
+    int64_t rem = seconds - days * 86400;
+    int year, month, day;
+    CivilFromDays(days, year, month, day);
+    int y = year - 1;
+    int64_t jan1 = 365LL * (y - 1969) + FloorDiv(y - 1968, 4) - FloorDiv(y - 1900, 100) + FloorDiv(y - 1600, 400);
+    tm = std::tm();
+    tm.tm_year = year - 1900;
+    tm.tm_mon = month - 1;
+    tm.tm_mday = day;
+    tm.tm_hour = static_cast<int>(rem / 3600);
+    tm.tm_min = static_cast<int>(rem / 60 % 60);
+    tm.tm_sec = static_cast<int>(rem % 60);
+    tm.tm_wday = static_cast<int>((days % 7 + 11) % 7);
+    tm.tm_yday = static_cast<int>(days - jan1);
+}
+
+void PutDigits(char* p, uint64_t value, int width)
+{
+    for(int i=width-1; i>=0; --i){
+        p[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+    }
+}
+
+// 纳秒部分的前 digits 位
+uint32_t SubsecondDigits(uint32_t nanos, int digits)
+{
+    for(int d = digits; d < 9; ++d){
+        nanos /= 10;
+    }
+    return nanos;
+}
+
+// 按 fmt 逐段渲染 sec 对应的日期时间: "UTC:" 前缀表示按 UTC, 否则按本地时区.
+// 连续的普通内容作为一段交给 text(segment, tm), 亚秒占位符 %ms/%us/%ns 交给 sub(digits), 任一返回 false 时停止
+template <typename TextFn, typename SubFn>
+bool RenderDateTime(const char* fmt, int64_t sec, TextFn&& text, SubFn&& sub)
+{
+    bool utc = std::strncmp(fmt, "UTC:", 4) == 0;
+    const char* p = utc ? fmt + 4 : fmt;
+    std::tm tm;
+    std::time_t t = static_cast<std::time_t>(sec);
+    if(utc){
+        UtcTime(sec, tm);
+    }
+    else{
+        localtime_r(&t, &tm);
+    }
+
+    LogBuffer segment;
+    auto flush_segment = [&]{
+        if(segment.empty()){
+            return true;
+        }
+        segment.push_back('\0');
+        bool ok = text(segment.data(), tm);
+        segment.clear();
+        return ok;
+    };
+    for(; *p; ++p){
+        if(p[0] == '%' && (p[1] == 'm' || p[1] == 'u' || p[1] == 'n') && p[2] == 's'){
+            if(!flush_segment() || !sub(p[1] == 'm' ? 3 : (p[1] == 'u' ? 6 : 9))){
+                return false;
+            }
+            p += 2;
+            continue;
+        }
+        segment.push_back(*p);
+        if(p[0] == '%' && p[1] != '\0'){
+            segment.push_back(*++p);
+        }
+    }
+    return flush_segment();
+}
+
+// 一个格式在某一秒的渲染结果, 亚秒占位符的位置单独记录
+struct DateTimeCache{
+    static constexpr size_t kMaxText = 128;
+    static constexpr size_t kMaxFormat = 64;
+    static constexpr size_t kMaxSubs = 4;
+
+    char format[kMaxFormat] = {0};          // 格式串(键)
+    int64_t second = INT64_MIN;             // 秒(键)
+    char text[kMaxText];
+    size_t len = 0;
+    struct{ uint16_t offset; uint8_t digits; } subs[kMaxSubs];
+    size_t sub_count = 0;
+
+    bool match(const char* fmt, int64_t sec) const {
+        return second == sec && std::strcmp(format, fmt) == 0;
+    }
+
+    // 渲染 fmt, 成功时填好文本与占位符位置; 放不下时返回 false
+    bool render(const char* fmt, int64_t sec){
+        second = INT64_MIN;
+        len = 0;
+        sub_count = 0;
+        bool ok = RenderDateTime(fmt, sec,
+            [&](const char* segment, const std::tm& tm){
+                size_t n = std::strftime(text + len, kMaxText - len, segment, &tm);
+                len += n;
+                return n != 0;
+            },
+            [&](int digits){
+                if(sub_count == kMaxSubs || len + digits > kMaxText){
+                    return false;
+                }
+                subs[sub_count].offset = static_cast<uint16_t>(len);
+                subs[sub_count].digits = static_cast<uint8_t>(digits);
+                ++sub_count;
+                len += digits;
+                return true;
+            });
+        if(ok){
+            second = sec;
+        }
+        return ok;
+    }
+
+    void patch(uint32_t nanos){
+        for(size_t i=0; i<sub_count; ++i){
+            PutDigits(text + subs[i].offset, SubsecondDigits(nanos, subs[i].digits), subs[i].digits);
+        }
+    }
+};
+
+// 2021-03-04T05:06:07.089Z
+void AppendIso8601(LogBuffer& buffer, int64_t sec, uint32_t nanos)
+{
+    int64_t days = FloorDiv(sec, 86400);
+    int64_t rem = sec - days * 86400;
+    int year, month, day;
+    CivilFromDays(days, year, month, day);
+    char* p = buffer.prepare(24);
+    PutDigits(p, year, 4);
+    p[4] = '-';
+    PutDigits(p + 5, month, 2);
+    p[7] = '-';
+    PutDigits(p + 8, day, 2);
+    p[10] = 'T';
+    PutDigits(p + 11, rem / 3600, 2);
+    p[13] = ':';
+    PutDigits(p + 14, rem / 60 % 60, 2);
+    p[16] = ':';
+    PutDigits(p + 17, rem % 60, 2);
+    p[19] = '.';
+    PutDigits(p + 20, nanos / 1000000, 3);
+    p[23] = 'Z';
+    buffer.commit(24);
+}
+
+} // namespace
+
+void LogFormatter::AppendDateTime(LogBuffer& buffer, time_point time, const char* format)
+{
+    using namespace std::chrono;
+    int64_t ns = duration_cast<nanoseconds>(time.time_since_epoch()).count();
+    int64_t sec = FloorDiv(ns, 1000000000);
+    uint32_t nanos = static_cast<uint32_t>(ns - sec * 1000000000);
+
+    if(format[0] == 'I' && std::strcmp(format, "ISO8601") == 0){
+        AppendIso8601(buffer, sec, nanos);
+        return;
+    }
+
+    // 每个线程缓存最近几个格式的渲染结果, 同一秒内只需修补亚秒数字
+    static constexpr size_t kEntries = 4;
+    thread_local DateTimeCache t_cache[kEntries];
+    thread_local size_t t_next = 0;
+    for(auto& entry : t_cache){
+        if(entry.match(format, sec)){
+            entry.patch(nanos);
+            buffer.append(entry.text, entry.len);
+            return;
+        }
+    }
+
+    DateTimeCache* entry = nullptr;
+    size_t format_len = std::strlen(format);
+    if(format_len < DateTimeCache::kMaxFormat){
+        for(auto& e : t_cache){
+            if(std::strcmp(e.format, format) == 0){
+                entry = &e;
+                break;
+            }
+        }
+        if(!entry){
+            entry = &t_cache[t_next++ % kEntries];
+            std::memcpy(entry->format, format, format_len + 1);
+        }
+        if(entry->render(format, sec)){
+            entry->patch(nanos);
+            buffer.append(entry->text, entry->len);
+            return;
+        }
+    }
+
+    // 格式过长或渲染结果放不下缓存时不缓存, 同样逐段渲染, 结果与缓存路径一致
+    RenderDateTime(format, sec,
+        [&](const char* segment, const std::tm& tm){
+            for(size_t cap = 256; cap <= 64 * 1024; cap *= 4){
+                size_t n = std::strftime(buffer.prepare(cap), cap, segment, &tm);
+                if(n > 0){
+                    buffer.commit(n);
+                    break;
+                }
+            }
+            return true;
+        },
+        [&](int digits){
+            PutDigits(buffer.prepare(digits), SubsecondDigits(nanos, digits), digits);
+            buffer.commit(digits);
+            return true;
+        });
+}
+
+void ThreadContext::Text::assign(std::string_view str)
+{
+    size = static_cast<uint8_t>(std::min(str.size(), sizeof(data) - 1));
+    std::memcpy(data, str.data(), size);
+}
+
+namespace {
+
+std::atomic<FiberIdProvider> s_fiber_provider{nullptr};
+
+// 常量初始化, 访问时没有线程局部变量的初始化检查
+thread_local ThreadContext t_thread;
+thread_local bool t_thread_loaded = false;
+
+void LoadThreadContext()
+{
+    // fork 出的子进程中唯一的线程换了线程号, 需要重新采集
+    static const int s_atfork = pthread_atfork(nullptr, nullptr, []{ t_thread_loaded = false; });
+    (void)s_atfork;
+    t_thread.tid = static_cast<uint32_t>(::syscall(SYS_gettid));
+    t_thread.tid_text.assign(t_thread.tid);
+    char name[16] = {0};
+    if(pthread_getname_np(pthread_self(), name, sizeof(name)) != 0){
+        name[0] = '\0';
+    }
+    t_thread.name.assign(std::string_view(name));
+    t_thread.fiber_id = 0;
+    t_thread.fiber_text.assign(0u);
+    t_thread_loaded = true;
+}
+
+ThreadContext MakeThreadContext(uint32_t thread_id, uint32_t fiber_id, std::string_view thread_name)
+{
+    ThreadContext thread;
+    thread.tid = thread_id;
+    thread.tid_text.assign(thread_id);
+    thread.fiber_id = fiber_id;
+    thread.fiber_text.assign(fiber_id);
+    thread.name.assign(thread_name);
+    return thread;
+}
+
+} // namespace
+
+const ThreadContext& ThreadContext::Current()
+{
+    if(!t_thread_loaded){
+        LoadThreadContext();
+    }
+    FiberIdProvider provider = s_fiber_provider.load(std::memory_order_relaxed);
+    uint32_t fiber_id = provider ? provider() : 0;
+    if(fiber_id != t_thread.fiber_id){
+        t_thread.fiber_id = fiber_id;
+        t_thread.fiber_text.assign(fiber_id);
+    }
+    return t_thread;
+}
+
+void setFiberIdProvider(FiberIdProvider provider)
+{
+    s_fiber_provider.store(provider, std::memory_order_relaxed);
+}
+
+void setThreadName(std::string_view name)
+{
+    if(!t_thread_loaded){
+        LoadThreadContext();
+    }
+    t_thread.name.assign(name);
+    pthread_setname_np(pthread_self(), t_thread.name.data);
+}
+
+namespace {
+
+int64_t ReadClock(clockid_t id)
+{
+    timespec ts;
+    ::clock_gettime(id, &ts);
+    return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+}
+
+const int64_t s_start_ns = ReadClock(CLOCK_REALTIME);
+std::atomic<LogClock::Source> s_clock_source{LogClock::Source::system};
+
+#if defined(__x86_64__)
+/**
+ * TSC 换算参数, 以顺序锁发布: 写者在 mutex 下把 seq 变为奇数、更新、再变为偶数,
+ * 读者在 seq 前后一致且为偶数时采用读到的参数
+ */
+struct TscCalibration{
+    static constexpr int64_t kInterval = 1000000000;    // 重新校准间隔(纳秒)
+
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint64_t> base_tsc{0};
+    std::atomic<int64_t> base_ns{0};
+    std::atomic<double> ns_per_tick{0};
+    std::atomic<uint64_t> next_tsc{UINT64_MAX};         // 到达后重新校准
+
+    std::mutex mutex;
+    uint64_t anchor_tsc = 0;                            // 长基线起点, 只在 mutex 下访问
+    int64_t anchor_ns = 0;
+
+    static bool Supported() {
+        unsigned eax, ebx, ecx, edx;
+        // CPUID.80000007H:EDX[8] 恒定 TSC
+        return __get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1u << 8));
+    }
+
+    // 取一对尽量同时的 (tsc, 墙钟纳秒), 多次采样取窗口最小的一次
+    static void Sample(uint64_t& tsc, int64_t& ns) {
+        uint64_t best = UINT64_MAX;
+        tsc = 0;
+        ns = 0;
+        for(int i=0; i<5; ++i){
+            uint64_t begin = __rdtsc();
+            int64_t now = ReadClock(CLOCK_REALTIME);
+            uint64_t end = __rdtsc();
+            if(end - begin < best){
+                best = end - begin;
+                tsc = begin + (end - begin) / 2;
+                ns = now;
+            }
+        }
+    }
+
+    void publishLocked(uint64_t tsc, int64_t ns, double rate) {
+        seq.fetch_add(1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        base_tsc.store(tsc, std::memory_order_relaxed);
+        base_ns.store(ns, std::memory_order_relaxed);
+        ns_per_tick.store(rate, std::memory_order_relaxed);
+        next_tsc.store(tsc + static_cast<uint64_t>(kInterval / rate), std::memory_order_relaxed);
+        seq.fetch_add(1, std::memory_order_release);
+    }
+
+    // 首次校准: 忙等约 10ms 测出频率
+    void calibrate() {
+        std::lock_guard<std::mutex> lock(mutex);
+        if(ns_per_tick.load(std::memory_order_relaxed) > 0){
+            return;
+        }
+        Sample(anchor_tsc, anchor_ns);
+        uint64_t tsc;
+        int64_t ns;
+        do{
+            Sample(tsc, ns);
+        }while(ns - anchor_ns < 10000000);
+        publishLocked(tsc, ns, static_cast<double>(ns - anchor_ns) / static_cast<double>(tsc - anchor_tsc));
+    }
+
+    // 按从 anchor 起累积的基线修正频率; 墙钟被调整导致偏差过大时只重新对齐, 并重置基线
+    void recalibrate() {
+        std::unique_lock<std::mutex> lock(mutex, std::try_to_lock);
+        if(!lock.owns_lock()){
+            return;
+        }
+        uint64_t tsc;
+        int64_t ns;
+        Sample(tsc, ns);
+        double rate = ns_per_tick.load(std::memory_order_relaxed);
+        double measured = static_cast<double>(ns - anchor_ns) / static_cast<double>(tsc - anchor_tsc);
+        if(measured > rate * 0.99 && measured < rate * 1.01){
+            rate = measured;
+        }
+        else{
+            anchor_tsc = tsc;
+            anchor_ns = ns;
+        }
+        publishLocked(tsc, ns, rate);
+    }
+
+    int64_t toNanoseconds(uint64_t tsc) {
+        if(tsc >= next_tsc.load(std::memory_order_relaxed)){
+            recalibrate();
+        }
+        for(;;){
+            uint32_t begin = seq.load(std::memory_order_acquire);
+            uint64_t base = base_tsc.load(std::memory_order_relaxed);
+            int64_t ns = base_ns.load(std::memory_order_relaxed);
+            double rate = ns_per_tick.load(std::memory_order_relaxed);
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if((begin & 1) == 0 && seq.load(std::memory_order_relaxed) == begin){
+                int64_t delta = static_cast<int64_t>(tsc - base);
+                return ns + static_cast<int64_t>(static_cast<double>(delta) * rate);
+            }
+        }
+    }
+};
+
+TscCalibration s_tsc;
+#endif
+
+} // namespace
+
+bool LogClock::SetSource(Source source)
+{
+    if(source == Source::tsc){
+#if defined(__x86_64__)
+        if(!TscCalibration::Supported()){
+            return false;
+        }
+        s_tsc.calibrate();
+#else
+        return false;
+#endif
+    }
+    s_clock_source.store(source, std::memory_order_relaxed);
+    return true;
+}
+
+LogClock::Source LogClock::GetSource()
+{
+    return s_clock_source.load(std::memory_order_relaxed);
+}
+
+LogClock::Stamp LogClock::Now()
+{
+    Source source = s_clock_source.load(std::memory_order_relaxed);
+    switch(source){
+    case Source::coarse:
+        return Stamp{static_cast<uint64_t>(ReadClock(CLOCK_REALTIME_COARSE)), source};
+#if defined(__x86_64__)
+    case Source::tsc:
+        return Stamp{__rdtsc(), source};
+#endif
+    default:
+        return Stamp{static_cast<uint64_t>(ReadClock(CLOCK_REALTIME)), Source::system};
+    }
+}
+
+int64_t LogClock::ToNanoseconds(Stamp stamp)
+{
+#if defined(__x86_64__)
+    if(stamp.source == Source::tsc){
+        return s_tsc.toNanoseconds(stamp.ticks);
+    }
+#endif
+    return static_cast<int64_t>(stamp.ticks);
+}
+
+int64_t LogClock::StartNanoseconds()
+{
+    return s_start_ns;
+}
+
+LogEvent::LogEvent(Logger* logger, const LogSite* site, uint32_t elapse,
+    uint32_t thread_id, uint32_t fiber_id, std::chrono::system_clock::time_point time, 
+    std::string_view thread_name)
+{
+    init(logger, site, elapse, MakeThreadContext(thread_id, fiber_id, thread_name),
+            LogClock::FromTimePoint(time));
+}
+
+void LogEvent::init(Logger* logger, const LogSite* site, std::optional<uint32_t> elapse,
+    const ThreadContext& thread, LogClock::Stamp stamp)
+{
+    site_ = site;
+    elapse_ = elapse;
+    thread_ = thread;
+    stamp_ = stamp;
+    logger_ = logger;
+}
+
+uint32_t LogEvent::getElapse() const
+{
+    if(elapse_){
+        return *elapse_;
+    }
+    int64_t ns = LogClock::ToNanoseconds(stamp_) - LogClock::StartNanoseconds();
+    return static_cast<uint32_t>(std::max<int64_t>(ns, 0) / 1000000);
+}
+
+void LogEvent::reset()
+{
+    ss_content_.reset();
+    fields_.shrink(64 * 1024);
+    binary_ = false;
+}
+
+void LogEvent::setFields(std::string_view fields)
+{
+    fields_.clear();
+    fields_.append(fields);
+}
+
+void LogEvent::setBinaryContent(std::string_view args)
+{
+    LogBuffer& buffer = ss_content_.buffer();
+    buffer.clear();
+    buffer.append(args);
+    binary_ = true;
+}
+
+namespace {
+
+template <typename T>
+bool TakeArg(const char*& p, const char* end, T& v)
+{
+    if(static_cast<size_t>(end - p) < sizeof(T)){
+        return false;
+    }
+    std::memcpy(&v, p, sizeof(T));
+    p += sizeof(T);
+    return true;
+}
+
+// 解码一个参数写入 ss, 数据不完整时返回 false
+bool DecodeArg(const char*& p, const char* end, LogStream& ss)
+{
+    uint8_t tag;
+    if(!TakeArg(p, end, tag)){
+        return false;
+    }
+    switch(static_cast<detail::ArgTag>(tag)){
+    case detail::ArgTag::i64:{
+        int64_t v;
+        if(!TakeArg(p, end, v)) return false;
+        ss << static_cast<long long>(v);
+        return true;
+    }
+    case detail::ArgTag::u64:{
+        uint64_t v;
+        if(!TakeArg(p, end, v)) return false;
+        ss << static_cast<unsigned long long>(v);
+        return true;
+    }
+    case detail::ArgTag::f64:{
+        double v;
+        if(!TakeArg(p, end, v)) return false;
+        ss << v;
+        return true;
+    }
+    case detail::ArgTag::boolean:{
+        uint8_t v;
+        if(!TakeArg(p, end, v)) return false;
+        ss << static_cast<bool>(v);
+        return true;
+    }
+    case detail::ArgTag::character:{
+        char v;
+        if(!TakeArg(p, end, v)) return false;
+        ss << v;
+        return true;
+    }
+    case detail::ArgTag::string:{
+        uint32_t len;
+        if(!TakeArg(p, end, len) || static_cast<size_t>(end - p) < len) return false;
+        ss << std::string_view(p, len);
+        p += len;
+        return true;
+    }
+    case detail::ArgTag::pointer:{
+        uint64_t v;
+        if(!TakeArg(p, end, v)) return false;
+        ss << reinterpret_cast<const void*>(v);
+        return true;
+    }
+    }
+    return false;
+}
+
+// 解码一个参数, 以 JSON 值写入 buffer, 数据不完整时返回 false
+bool DecodeJsonValue(const char*& p, const char* end, LogBuffer& buffer)
+{
+    uint8_t tag;
+    if(!TakeArg(p, end, tag)){
+        return false;
+    }
+    char* out = buffer.prepare(32);
+    switch(static_cast<detail::ArgTag>(tag)){
+    case detail::ArgTag::i64:{
+        int64_t v;
+        if(!TakeArg(p, end, v)) return false;
+        buffer.commit(std::to_chars(out, out + 32, v).ptr - out);
+        return true;
+    }
+    case detail::ArgTag::u64:{
+        uint64_t v;
+        if(!TakeArg(p, end, v)) return false;
+        buffer.commit(std::to_chars(out, out + 32, v).ptr - out);
+        return true;
+    }
+    case detail::ArgTag::f64:{
+        double v;
+        if(!TakeArg(p, end, v)) return false;
+        if(!std::isfinite(v)){
+            buffer.append("null");
+            return true;
+        }
+        buffer.commit(std::to_chars(out, out + 32, v).ptr - out);
+        return true;
+    }
+    case detail::ArgTag::boolean:{
+        uint8_t v;
+        if(!TakeArg(p, end, v)) return false;
+        buffer.append(v ? std::string_view("true") : std::string_view("false"));
+        return true;
+    }
+    case detail::ArgTag::character:{
+        char v;
+        if(!TakeArg(p, end, v)) return false;
+        LogFormatter::AppendJsonString(buffer, std::string_view(&v, 1));
+        return true;
+    }
+    case detail::ArgTag::string:{
+        uint32_t len;
+        if(!TakeArg(p, end, len) || static_cast<size_t>(end - p) < len) return false;
+        LogFormatter::AppendJsonString(buffer, std::string_view(p, len));
+        p += len;
+        return true;
+    }
+    case detail::ArgTag::pointer:{
+        uint64_t v;
+        if(!TakeArg(p, end, v)) return false;
+        out[0] = '"';
+        out[1] = '0';
+        out[2] = 'x';
+        char* last = std::to_chars(out + 3, out + 31, v, 16).ptr;
+        *last = '"';
+        buffer.commit(last + 1 - out);
+        return true;
+    }
+    }
+    return false;
+}
+
+} // namespace
+
+void LogFormatter::AppendJson(LogBuffer& buffer, const LogEvent& event)
+{
+    buffer.append("{\"time\":\"");
+    AppendDateTime(buffer, event.getTime(), "ISO8601");
+    buffer.append("\",\"level\":\"");
+    buffer.append(std::string_view(LogLevel::ToString(event.getLevel())));
+    buffer.append("\",\"logger\":");
+    AppendJsonString(buffer, event.getLogger()->getName());
+    buffer.append(",\"thread\":");
+    buffer.append(event.getThreadIdText());
+    buffer.append(",\"thread_name\":");
+    AppendJsonString(buffer, event.getThreadName());
+    buffer.append(",\"fiber\":");
+    buffer.append(event.getFiberIdText());
+    buffer.append(",\"file\":");
+    AppendJsonString(buffer, event.getFile());
+    buffer.append(",\"line\":");
+    AppendNumber(buffer, event.getLine());
+    buffer.append(",\"func\":");
+    AppendJsonString(buffer, event.getFunction());
+    buffer.append(",\"elapse\":");
+    AppendNumber(buffer, event.getElapse());
+    buffer.append(",\"message\":");
+    AppendJsonString(buffer, event.getContentView());
+
+    std::string_view fields = event.getFields();
+    if(!fields.empty()){
+        buffer.append(",\"fields\":{");
+        const char* p = fields.data();
+        const char* end = p + fields.size();
+        bool first = true;
+        while(p < end){
+            // 键与值都完整才输出, 残缺的尾部丢弃
+            size_t size = buffer.size();
+            if(!first){
+                buffer.push_back(',');
+            }
+            uint8_t tag = 0;
+            const char* key = p;
+            if(!TakeArg(key, end, tag) || tag != static_cast<uint8_t>(detail::ArgTag::string)
+                    || !DecodeJsonValue(p, end, buffer)){
+                buffer.truncate(size);
+                break;
+            }
+            buffer.push_back(':');
+            if(!DecodeJsonValue(p, end, buffer)){
+                buffer.truncate(size);
+                break;
+            }
+            first = false;
+        }
+        buffer.push_back('}');
+    }
+    buffer.push_back('}');
+}
+
+void LogEvent::materialize()
+{
+    if(!binary_){
+        return;
+    }
+    binary_ = false;
+    thread_local LogBuffer t_args;
+    t_args.clear();
+    t_args.append(ss_content_.view());
+    ss_content_.buffer().clear();
+
+    std::string_view rest = site_->fmt ? site_->fmt : "";
+    const char* p = t_args.data();
+    const char* end = p + t_args.size();
+    while(p < end){
+        rest = printField(rest);
+        if(!DecodeArg(p, end, ss_content_)){
+            break;
+        }
+    }
+    printField(rest);
+}
+
+namespace detail {
+LogStream& ArgStream()
+{
+    thread_local LogStream t_stream;
+    return t_stream;
+}
+} // namespace detail
+
+namespace {
+
+// 全局空闲链表, 线程本地缓存不足或过多时与之批量交换
+struct LogEventFreeList{
+    std::mutex mutex;
+    LogEvent* head = nullptr;
+};
+
+LogEventFreeList& GetFreeList(){
+    // 故意不析构, 避免其他静态对象析构时还在回收事件
+    static LogEventFreeList* s_list = new LogEventFreeList;
+    return *s_list;
+}
+
+} // namespace
+
+// 线程本地的事件缓存
+class LogEventPool{
+public:
+    static constexpr size_t kBatch = 32;       // 与全局链表交换的批量
+    static constexpr size_t kMaxCached = 256;  // 线程本地最多缓存的事件数
+
+    ~LogEventPool(){
+        s_destroyed = true;
+        if(head_){
+            auto& list = GetFreeList();
+            LogEvent* tail = head_;
+            while(tail->next_){
+                tail = tail->next_;
+            }
+            std::lock_guard<std::mutex> lock(list.mutex);
+            tail->next_ = list.head;
+            list.head = head_;
+        }
+    }
+
+    LogEvent* acquire(){
+        if(!head_){
+            refill();
+        }
+        if(!head_){
+            return new LogEvent();
+        }
+        LogEvent* event = head_;
+        head_ = event->next_;
+        event->next_ = nullptr;
+        --size_;
+        return event;
+    }
+
+    void release(LogEvent* event){
+        event->next_ = head_;
+        head_ = event;
+        if(++size_ > kMaxCached){
+            spill();
+        }
+    }
+
+    static LogEventPool* Get(){
+        if(s_destroyed){
+            return nullptr;
+        }
+        thread_local LogEventPool t_pool;
+        return &t_pool;
+    }
+
+private:
+    void refill(){
+        auto& list = GetFreeList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        for(size_t i=0; i<kBatch && list.head; ++i){
+            LogEvent* event = list.head;
+            list.head = event->next_;
+            event->next_ = head_;
+            head_ = event;
+            ++size_;
+        }
+    }
+
+    void spill(){
+        LogEvent* first = head_;
+        LogEvent* last = head_;
+        for(size_t i=1; i<kBatch; ++i){
+            last = last->next_;
+        }
+        head_ = last->next_;
+        size_ -= kBatch;
+        auto& list = GetFreeList();
+        std::lock_guard<std::mutex> lock(list.mutex);
+        last->next_ = list.head;
+        list.head = first;
+    }
+
+private:
+    LogEvent* head_ = nullptr;
+    size_t size_ = 0;
+    static thread_local bool s_destroyed;
+};
+
+thread_local bool LogEventPool::s_destroyed = false;
+
+LogEvent::ptr LogEvent::Create(Logger* logger, const LogSite* site, uint32_t elapse,
+    uint32_t thread_id, uint32_t fiber_id, time_point time, 
+    std::string_view thread_name)
+{
+    LogEventPool* pool = LogEventPool::Get();
+    LogEvent* event = pool ? pool->acquire() : new LogEvent();
+    event->init(logger, site, elapse, MakeThreadContext(thread_id, fiber_id, thread_name),
+            LogClock::FromTimePoint(time));
+    return LogEvent::ptr(event);
+}
+
+LogEvent::ptr LogEvent::Create(Logger* logger, const LogSite* site)
+{
+    const ThreadContext& thread = ThreadContext::Current();
+    LogEventPool* pool = LogEventPool::Get();
+    LogEvent* event = pool ? pool->acquire() : new LogEvent();
+    event->init(logger, site, std::nullopt, thread, LogClock::Now());
+    return LogEvent::ptr(event);
+}
+
+void LogEvent::Recycle(LogEvent* event)
+{
+    event->reset();
+    event->logger_ = nullptr;
+    LogEventPool* pool = LogEventPool::Get();
+    if(pool){
+        pool->release(event);
+        return;
+    }
+    auto& list = GetFreeList();
+    std::lock_guard<std::mutex> lock(list.mutex);
+    event->next_ = list.head;
+    list.head = event;
+}
+
+void LogEvent::format(const char *fmt, ...)
+{
+    va_list al;
+    va_start(al, fmt);
+    format(fmt, al);
+    va_end(al);
+}
+
+void LogEvent::format(const char* fmt, va_list al) {
+    // 直接格式化到内容缓冲的空闲空间, 放不下时按实际长度扩容再格式化一次
+    LogBuffer& buffer = ss_content_.buffer();
+    char* p = buffer.prepare(256);
+    size_t avail = buffer.capacity() - buffer.size();
+
+    va_list al_copy;
+    va_copy(al_copy, al);
+    int len = vsnprintf(p, avail, fmt, al_copy);
+    va_end(al_copy);
+
+    if (len < 0) {
+        return;
+    }
+    if (static_cast<size_t>(len) >= avail) {
+        p = buffer.prepare(static_cast<size_t>(len) + 1);
+        vsnprintf(p, static_cast<size_t>(len) + 1, fmt, al);
+    }
+    buffer.commit(len);
+}
+
+std::string_view LogEvent::printField(std::string_view fmt)
+{
+    LogBuffer& buffer = ss_content_.buffer();
+    size_t begin = 0;
+    for(size_t i=0; i<fmt.size(); ++i){
+        if(fmt[i] != '{' && fmt[i] != '}'){
+            continue;
+        }
+        buffer.append(fmt.data() + begin, i - begin);
+        if(i + 1 < fmt.size() && fmt[i] == '{' && fmt[i+1] == '}'){
+            return fmt.substr(i + 2);
+        }
+        // "{{" 或 "}}" 转义
+        buffer.push_back(fmt[i]);
+        begin = ++i + 1;
+    }
+    buffer.append(fmt.data() + begin, fmt.size() - begin);
+    return std::string_view();
+}
+
+Logger::Logger(LogLevel::Level level, const std::string & name)
+    : name_(name), effective_(std::make_shared<Snapshot>(Snapshot{level, {}})), level_(level), effective_level_(level)
+{
+    formatter_.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+}
+
+void Logger::log(LogEvent::ptr event)
+{
+    // 只读取当前快照, 不加锁; 快照在本次分发期间保持有效, 级别与输出器来自同一次发布
+    std::shared_ptr<const Snapshot> snapshot = effective_.load(std::memory_order_acquire);
+    if(snapshot->level > event->getLevel()){
+        return;
+    }
+    metrics_.add(static_cast<size_t>(event->getLevel()), 1);
+    const AppenderList* appenders = &snapshot->appenders;
+    // 有文本输出器时在分发前统一渲染, 避免与异步输出器中的读取竞争
+    if(event->isBinary()){
+        for(auto& i : *appenders){
+            if(!i->isBinary()){
+                event->materialize();
+                break;
+            }
+        }
+    }
+    // 格式化结果按格式化器缓存在线程本地缓冲中; 输出器内部再次记录日志时不复用, 走 log(event)
+    struct Rendered{
+        LogFormatter::ptr formatter;
+        size_t offset;
+        size_t size;
+    };
+    static constexpr size_t kMaxRendered = 4;
+    thread_local LogBuffer t_text;
+    thread_local bool t_busy = false;
+    Rendered rendered[kMaxRendered];
+    size_t count = 0;
+    bool reuse = !t_busy;
+    if(reuse){
+        t_busy = true;
+        t_text.clear();
+    }
+    for(auto& i : *appenders){
+        i->metrics_.add(LogMetrics::kEvents, 1);
+        if(!reuse || !i->acceptsFormatted()){
+            i->log(event);
+            continue;
+        }
+        LogFormatter::ptr formatter = i->getFormatter();
+        if(!formatter){
+            i->log(event);
+            continue;
+        }
+        size_t n = 0;
+        while(n < count && rendered[n].formatter != formatter){
+            ++n;
+        }
+        if(n == count){
+            if(count == kMaxRendered){
+                i->log(event);
+                continue;
+            }
+            size_t offset = t_text.size();
+            uint64_t begin = LogMetrics::Now();
+            formatter->format(t_text, *event);
+            i->metrics_.add(LogMetrics::kFormatNs, LogMetrics::Now() - begin);
+            rendered[count++] = Rendered{std::move(formatter), offset, t_text.size() - offset};
+        }
+        i->logFormatted(*event, std::string_view(t_text.data() + rendered[n].offset, rendered[n].size));
+    }
+    if(reuse){
+        t_busy = false;
+    }
+    if(event->getLevel() == LogLevel::Level::fatal){
+        for(auto& i : *appenders){
+            i->flush();
+        }
+        LoggerManager::getInstance().flushAll();
+    }
+}
+
+std::mutex& Logger::HierarchyMutex()
+{
+    static std::mutex s_mutex;
+    return s_mutex;
+}
+
+void Logger::updateLocked()
+{
+    if(!level_set_ && parent_){
+        level_ = parent_->effective_level_.load(std::memory_order_relaxed);
+    }
+    effective_level_.store(level_, std::memory_order_relaxed);
+
+    auto snapshot = std::make_shared<Snapshot>(Snapshot{level_, appenders_});
+    AppenderList& list = snapshot->appenders;
+    if(additive_ && parent_){
+        std::shared_ptr<const Snapshot> inherited = parent_->effective_.load(std::memory_order_relaxed);
+        for(auto& i : inherited->appenders){
+            if(std::find(list.begin(), list.end(), i) == list.end()){
+                list.push_back(i);
+            }
+        }
+    }
+    effective_.store(std::move(snapshot), std::memory_order_release);
+
+    for(auto child : children_){
+        child->updateLocked();
+    }
+}
+
+void Logger::setParentLocked(Logger::ptr parent)
+{
+    parent_ = parent;
+    parent_->children_.push_back(this);
+    updateLocked();
+}
+
+void Logger::setLevel(LogLevel::Level level)
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    level_ = level;
+    level_set_ = true;
+    updateLocked();
+}
+
+void Logger::unsetLevel()
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    if(parent_){
+        level_set_ = false;
+        updateLocked();
+    }
+}
+
+bool Logger::hasLevel() const
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    return level_set_;
+}
+
+void Logger::setAdditivity(bool additive)
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    additive_ = additive;
+    updateLocked();
+}
+
+bool Logger::getAdditivity() const
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    return additive_;
+}
+
+void Logger::addAppender(LogAppender::ptr appender)
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    addAppenderLocked(appender);
+}
+
+void Logger::addAppenderLocked(LogAppender::ptr appender)
+{
+    if(!appender->getFormatter()){
+        appender->setFormatter(formatter_);
+    }
+    appenders_.push_back(appender);
+    updateLocked();
+}
+
+void Logger::delAppender(LogAppender::ptr appender)
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    auto it = std::find(appenders_.begin(), appenders_.end(), appender);
+    if(it != appenders_.end()){
+        appenders_.erase(it);
+        updateLocked();
+    }
+}
+
+void Logger::clearAppender()
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    appenders_.clear();
+    updateLocked();
+}
+
+void Logger::addStdoutAppender()
+{
+    // 共享的标准输出器只挂一次, 并发的 simple_init 不会重复输出
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    if(std::find(appenders_.begin(), appenders_.end(), stdout_appender_) == appenders_.end()){
+        addAppenderLocked(stdout_appender_);
+    }
+}
+
+bool Logger::hasStdoutAppender() const
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    for(auto& i : appenders_){
+        if(dynamic_cast<StdoutLogAppender*>(i.get())){
+            return true;
+        }
+    }
+    return false;
+}
+
+void Logger::addFileAppender(const std::string &filename)
+{
+    addAppender(std::make_shared<FileLogAppender>(filename));
+}
+
+void Logger::setFormatter(LogFormatter::ptr val)
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    formatter_ = val;
+    for(auto& i : appenders_){
+        if(!i->hasFormatter()){
+            i->setFormatter(formatter_);
+        }
+    }
+}
+
+void Logger::setFormatter(std::string &val)
+{
+    LogFormatter::ptr new_val(new LogFormatter(val));
+    if(new_val->isError()){
+        std::cout << "Logger setFormatter name=" << name_ << " value=" << val << " invalid formatter" << std::endl;
+        return;
+    }
+    setFormatter(new_val);
+}
+
+LogFormatter::ptr Logger::getFormatter() const
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    return formatter_;
+}
+
+std::vector<LogAppender::ptr> Logger::getAppenders() const
+{
+    std::lock_guard<std::mutex> lock(HierarchyMutex());
+    return appenders_;
+}
+
+void Logger::collectMetrics(LogMetrics::LoggerStats& stats) const
+{
+    stats.name = name_;
+    for(size_t i=0; i<6; ++i){
+        stats.emitted[i] = metrics_.load(i);
+    }
+    stats.filtered = metrics_.load(LogMetrics::kFiltered);
+}
+
+void LogAppender::setFormatter(LogFormatter::ptr val)
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    if(!formatter_) hasFormatter_ = true;
+    formatter_ = val;
+    published_formatter_.store(std::move(val), std::memory_order_release);
+}
+
+LogFormatter::ptr LogAppender::getFormatter() const
+{
+    // 共享的输出器(如 stdout)在每条日志上都会取格式化器, 不能争用 mutex_
+    return published_formatter_.load(std::memory_order_acquire);
+}
+
+bool LogAppender::hasFormatter() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return hasFormatter_;
 }
 
-class MessageFormatItem : public LogFormatter::FormatItem{
-public:
-    MessageFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getContent();
-    }
-    std::string toString() const override {
-        return "message";
-    }
-};
-
-class LevelFormatItem : public LogFormatter::FormatItem{
-public:
-    LevelFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << LogLevel::ToString(event->getLevel());
-    }
+void LogAppender::collectMetrics(LogMetrics::AppenderStats& stats) const
+{
+    stats.name = getName();
+    stats.events = metrics_.load(LogMetrics::kEvents);
+    stats.bytes = metrics_.load(LogMetrics::kBytes);
+    stats.format_ns = metrics_.load(LogMetrics::kFormatNs);
+    stats.write_ns = metrics_.load(LogMetrics::kWriteNs);
+    stats.lock_wait_ns = metrics_.load(LogMetrics::kLockWaitNs);
+}
 
-    std::string toString() const override {
-        return "level";
+std::unique_lock<std::mutex> LogAppender::lockMetered()
+{
+    std::unique_lock<std::mutex> lock(mutex_, std::try_to_lock);
+    if(!lock.owns_lock()){
+        uint64_t begin = LogMetrics::Now();
+        lock.lock();
+        metrics_.add(LogMetrics::kLockWaitNs, LogMetrics::Now() - begin);
     }
-};
+    return lock;
+}
 
-class ElapseFormatItem : public LogFormatter::FormatItem{
-public:
-    ElapseFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getElapse();
-    }
+namespace detail {
+void LogSuppressed(Logger* logger, const LogSite* site, uint64_t count)
+{
+    LogEventWrap(LogEvent::Create(logger, site))
+        .getSS() << "suppressed " << count << " messages";
+}
+} // namespace detail
 
-    std::string toString() const override {
-        return "elapse";
-    }
-};
+LogEventWrap::LogEventWrap(LogEvent::ptr e) : event_(e)
+{
+}
 
-class NameFormatItem : public LogFormatter::FormatItem{
-public:
-    NameFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getLogger()->getName();
-    }
-    std::string toString() const override {
-        return "name";
-    }
-};
+LogEventWrap::~LogEventWrap()
+{
+    Logger* logger = event_->getLogger();
+    logger->log(std::move(event_));
+}
 
-class ThreadIdFormatItem : public LogFormatter::FormatItem{
-public:
-    ThreadIdFormatItem(const std::string& str = ""){}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getThreadId();
-    }
-    std::string toString() const override {
-        return "threadId";
-    }
-};
+namespace {
 
-class FiberIdFormatItem : public LogFormatter::FormatItem {
+/**
+ * @brief 按写出间隔定时写出输出器缓冲的后台线程, 所有输出器共用一个
+ * @details 输出器在缓冲由空变为非空时用 schedule 登记到期时间, 到期后在后台线程回调输出器写出.
+ *          回调时不持有本对象的锁, 输出器可以在持有自身锁时调用 schedule.
+ */
+class FlushTimer{
 public:
-    FiberIdFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getFiberId();
-    }
-    std::string toString() const override {
-        return "FiberId";
+    using clock = std::chrono::steady_clock;
+    // 写出已到期的缓冲, 返回下一次到期时间, 没有待写出的内容时返回 time_point::max()
+    using Callback = std::function<clock::time_point()>;
+
+    static FlushTimer& Instance() {
+        // 不析构: 进程退出时静态对象的析构顺序不定, 仍可能有输出器在注销
+        static FlushTimer* s_timer = new FlushTimer();
+        return *s_timer;
     }
-};
 
-class ThreadNameFormatItem : public LogFormatter::FormatItem {
-public:
-    ThreadNameFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getThreadName();
+    void add(const void* owner, Callback callback) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        entries_.push_back({owner, std::move(callback), clock::time_point::max()});
     }
-    std::string toString() const override {
-        return "threadName";
+    /**
+     * @brief 注销, 返回后不会再回调 owner
+     */
+    void remove(const void* owner) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        idle_cv_.wait(lock, [&]{ return calling_ != owner; });
+        entries_.remove_if([&](const Entry& e){ return e.owner == owner; });
     }
-};
-
-class DateTimeFormatItem : public LogFormatter::FormatItem {
-public:
-    DateTimeFormatItem(const std::string& format = "%Y-%m-%d %H:%M:%S") : format_(format){
-        if(format_.empty()){
-            format_ = "%Y-%m-%d %H:%M:%S";
+    void schedule(const void* owner, clock::time_point due) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        for(auto& e : entries_){
+            if(e.owner == owner){
+                e.due = std::min(e.due, due);
+                break;
+            }
+        }
+        if(!started_){
+            started_ = true;
+            std::thread(&FlushTimer::run, this).detach();
+        }
+        else if(due < wake_){
+            cv_.notify_one();
         }
     }
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        using namespace std::chrono;
-        auto tp = event->getTime();
-        std::time_t t = system_clock::to_time_t(tp);
-        std::tm *tm = std::localtime(&t);
-        os << std::put_time(tm, format_.c_str());
 
+private:
+    FlushTimer() {
+        // fork 出的子进程中没有后台线程, 下一次 schedule 时重新启动
+        pthread_atfork(nullptr, nullptr, []{ Instance().started_ = false; });
     }
-    std::string toString() const override {
-        return "time";
+
+    void run() {
+        std::unique_lock<std::mutex> lock(mutex_);
+        for(;;){
+            auto now = clock::now();
+            auto next = clock::time_point::max();
+            Entry* due = nullptr;
+            for(auto& e : entries_){
+                if(e.due <= now){
+                    due = &e;
+                    break;
+                }
+                next = std::min(next, e.due);
+            }
+            if(due){
+                // 正在回调的条目不会被 remove 删除, std::list 中其他条目的增删不影响它
+                due->due = clock::time_point::max();
+                calling_ = due->owner;
+                lock.unlock();
+                clock::time_point again = due->callback();
+                lock.lock();
+                due->due = std::min(due->due, again);
+                calling_ = nullptr;
+                idle_cv_.notify_all();
+                continue;
+            }
+            wake_ = next;
+            if(next == clock::time_point::max()){
+                cv_.wait(lock);
+            }
+            else{
+                cv_.wait_until(lock, next);
+            }
+            wake_ = clock::time_point::min();
+        }
     }
 
 private:
-    std::string format_;
+    struct Entry{
+        const void* owner;
+        Callback callback;
+        clock::time_point due;
+    };
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::condition_variable idle_cv_;
+    std::list<Entry> entries_;
+    const void* calling_ = nullptr;
+    clock::time_point wake_ = clock::time_point::min();    // 后台线程的唤醒时间, 不在等待时为 min
+    bool started_ = false;
 };
 
-class FilenameFormatItem : public LogFormatter::FormatItem {
-public:
-    FilenameFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getFile();
-    }
-    std::string toString() const override {
-        return "filename";
-    }
-};
+std::string_view ColorOf(LogLevel::Level level)
+{
+    static constexpr std::string_view kColors[] = {
+        "",                 // unknow
+        "\x1b[36m",         // debug
+        "\x1b[32m",         // info
+        "\x1b[33m",         // warn
+        "\x1b[31m",         // error
+        "\x1b[1;31m"        // fatal
+    };
+    size_t index = static_cast<size_t>(level);
+    return index < std::size(kColors) ? kColors[index] : "";
+}
 
-class LineFormatItem : public LogFormatter::FormatItem {
-public:
-    LineFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << event->getLine();
+// 颜色在换行之前复位
+void ResetColor(LogBuffer& buffer, std::string_view color)
+{
+    if(color.empty()){
+        return;
     }
-    std::string toString() const override {
-        return "line";
+    if(buffer.size() > color.size() && buffer.data()[buffer.size() - 1] == '\n'){
+        buffer.data()[buffer.size() - 1] = '\x1b';
+        buffer.append("[0m\n");
     }
-};
+    else{
+        buffer.append("\x1b[0m");
+    }
+}
 
-class NewLineFormatItem : public LogFormatter::FormatItem {
-public:
-    NewLineFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << std::endl;
+} // namespace
+
+StdoutLogAppender::StdoutLogAppender()
+    : StdoutLogAppender(Options())
+{
+}
+
+StdoutLogAppender::StdoutLogAppender(const Options& options)
+    : options_(options), fd_(static_cast<int>(options.target))
+{
+    tty_ = ::isatty(fd_) == 1;
+    if(!tty_ && options_.interval.count() > 0){
+        FlushTimer::Instance().add(this, [this]{
+            std::lock_guard<std::mutex> lock(mutex_);
+            if(batch_.empty()){
+                return FlushTimer::clock::time_point::max();
+            }
+            auto due = pending_since_ + options_.interval;
+            if(FlushTimer::clock::now() < due){
+                return due;
+            }
+            flushLocked();
+            return FlushTimer::clock::time_point::max();
+        });
     }
-    std::string toString() const override {
-        return "newline";
+    CrashHandler::Register(this);
+}
+
+StdoutLogAppender::~StdoutLogAppender()
+{
+    CrashHandler::Unregister(this);
+    if(!tty_ && options_.interval.count() > 0){
+        FlushTimer::Instance().remove(this);
     }
-};
+    flushLocked();
+}
 
-class StringFormatItem : public LogFormatter::FormatItem {
-public:
-    StringFormatItem(const std::string& str)
-        :string_(str) {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << string_;
+void StdoutLogAppender::log(LogEvent::ptr event)
+{
+    thread_local LogBuffer t_line;
+    t_line.clear();
+    LogFormatter::ptr formatter = getFormatter();
+    uint64_t begin = LogMetrics::Now();
+    if(options_.color){
+        formatColored(t_line, *formatter, *event);
     }
-    std::string toString() const override {
-        return "string";
+    else{
+        formatter->format(t_line, *event);
     }
-private:
-    std::string string_;
-};
+    metrics_.add(LogMetrics::kFormatNs, LogMetrics::Now() - begin);
+    write(t_line.view(), event->getLevel());
+}
 
-class TabFormatItem : public LogFormatter::FormatItem {
-public:
-    TabFormatItem(const std::string& str = "") {}
-    void format(std::ostream& os, LogEvent::ptr event) override {
-        os << "\t";
-    }
-    std::string toString() const override {
-        return "tab";
+void StdoutLogAppender::logFormatted(const LogEvent& event, std::string_view text)
+{
+    if(!options_.color){
+        write(text, event.getLevel());
+        return;
     }
-};
+    thread_local LogBuffer t_line;
+    t_line.clear();
+    std::string_view color = ColorOf(event.getLevel());
+    t_line.append(color);
+    t_line.append(text);
+    ResetColor(t_line, color);
+    write(t_line.view(), event.getLevel());
+}
 
-LogFormatter::LogFormatter(const std::string &pattern) : pattern_(pattern)
+void StdoutLogAppender::write(std::string_view line, LogLevel::Level level)
 {
-    init();
+    metrics_.add(LogMetrics::kBytes, line.size());
+    if(tty_){
+        writeAll(line.data(), line.size());
+        return;
+    }
+    auto lock = lockMetered();
+    bool first = batch_.empty();
+    batch_.append(line);
+    if(batch_.size() >= options_.batch_bytes || level >= LogLevel::Level::error || options_.interval.count() == 0){
+        flushLocked();
+    }
+    else if(first && options_.interval.count() > 0){
+        // 缓冲中最早的一行最迟在 interval 后由后台定时器写出
+        pending_since_ = std::chrono::steady_clock::now();
+        FlushTimer::Instance().schedule(this, pending_since_ + options_.interval);
+    }
 }
 
-template <typename T>
-std::function<LogFormatter::FormatItem::ptr(const std::string& str)> LogFormatter::create_format_item() {
-    return [](const std::string& fmt) { return LogFormatter::FormatItem::ptr(new T(fmt)); };
+void StdoutLogAppender::formatColored(LogBuffer& buffer, const LogFormatter& formatter, const LogEvent& event)
+{
+    std::string_view color = ColorOf(event.getLevel());
+    buffer.append(color);
+    formatter.format(buffer, event);
+    ResetColor(buffer, color);
 }
 
-// %x  %x{xxx}  %%
-void LogFormatter::init()
+void StdoutLogAppender::flush()
 {
-    // string, format, type
-    std::vector<std::tuple<std::string, std::string, int>> items;
-    std::string normal_str;
-    for(std::size_t i=0; i<pattern_.size(); ++i){
-        if(pattern_[i] != '%'){
-            normal_str += pattern_[i];
-            continue;
-        }
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushLocked();
+}
 
-        if(i+1 < pattern_.size() && pattern_[i+1] == '%'){
-            normal_str += pattern_[i+1];
-            continue;
-        }
+namespace {
 
-        int flag = 0;
-        size_t str_begin = ++i;
-        size_t fmt_begin = i;
-        std::string str;
-        std::string fmt_str;
-        while(i < pattern_.size()){
-            if(!flag && !std::isalpha(pattern_[i]) && pattern_[i] != '{' && pattern_[i] != '}') {
-                if(str.empty()){
-                    str = pattern_.substr(str_begin, i - str_begin);
-                }
-                --i;
-                break;
-            }
-            if(flag == 0 && pattern_[i] == '{'){
-                str = pattern_.substr(str_begin, i - str_begin);
-                flag = 1;
-                fmt_begin = ++i;
-                continue;
-            }
-            else if(flag == 1 && pattern_[i] == '}'){
-                fmt_str = pattern_.substr(fmt_begin, i - fmt_begin);
-                flag = 0;
-                ++i;
+// 崩溃时写出缓冲, 只用异步信号安全的调用
+void DrainBuffer(int fd, LogBuffer& buffer)
+{
+    const char* p = buffer.data();
+    size_t left = buffer.size();
+    while(left > 0){
+        ssize_t n = ::write(fd, p, left);
+        if(n < 0){
+            if(errno == EINTR){
                 continue;
             }
-            ++i;
-            if(i == pattern_.size() && str.empty()){
-                str = pattern_.substr(str_begin);
-            }
+            break;
         }
-        if(flag == 0){
-            if(!normal_str.empty()){
-                items.emplace_back(normal_str, std::string(), 0);
-                normal_str.clear();
-            }
-            items.emplace_back(str, fmt_str, 1);
-        }
-        else if(flag == 1){
-            std::cout << "pattern pharse error: " << pattern_ << "-" << pattern_.substr(i) << std::endl;
-            error_ = true;
-            items.emplace_back("<<pattern error>>", fmt_str, 0);
-        }
-    }
-
-    if(!normal_str.empty()){
-        items.emplace_back(normal_str, std::string(), 0);
-    }
-    // 使用函数模板填充map
-    static std::unordered_map<std::string, std::function<FormatItem::ptr(const std::string& str)> > s_format_items = {
-        {"m", create_format_item<MessageFormatItem>()},           //m:消息
-        {"p", create_format_item<LevelFormatItem>()},             //p:日志级别
-        {"r", create_format_item<ElapseFormatItem>()},            //r:累计毫秒数
-        {"c", create_format_item<NameFormatItem>()},              //c:日志名称
-        {"t", create_format_item<ThreadIdFormatItem>()},          //t:线程id
-        {"n", create_format_item<NewLineFormatItem>()},           //n:换行
-        {"d", create_format_item<DateTimeFormatItem>()},          //d:时间
-        {"f", create_format_item<FilenameFormatItem>()},          //f:文件名
-        {"l", create_format_item<LineFormatItem>()},              //l:行号
-        {"T", create_format_item<TabFormatItem>()},               //T:Tab
-        {"F", create_format_item<FiberIdFormatItem>()},           //F:协程id
-        {"N", create_format_item<ThreadNameFormatItem>()},        //N:线程名称
-    };
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    buffer.clear();
+}
 
+} // namespace
 
-    for(auto& i : items) {
-        if(std::get<2>(i) == 0) {
-            items_.push_back(FormatItem::ptr(new StringFormatItem(std::get<0>(i))));
-        } else {
-            auto it = s_format_items.find(std::get<0>(i));
-            if(it == s_format_items.end()) {
-                items_.push_back(FormatItem::ptr{new StringFormatItem("<<error_format %" + std::get<0>(i) + ">>")});
-                error_ = true;
-            } else {
-                items_.push_back(it->second(std::get<1>(i)));
-            }
-        }
-    }
+void StdoutLogAppender::drain()
+{
+    // 不加锁: 崩溃的线程可能正持有 mutex_
+    DrainBuffer(fd_, batch_);
 }
 
-std::string LogFormatter::format(LogEvent::ptr event)
+void StdoutLogAppender::flushLocked()
 {
-    std::stringstream ss;
-    for(auto &i : items_){
-        i->format(ss, event);
+    if(!batch_.empty()){
+        writeAll(batch_.data(), batch_.size());
+        batch_.clear();
     }
-    return ss.str();
 }
 
-std::ostream &LogFormatter::format(std::ostream &os, LogEvent::ptr event)
+void StdoutLogAppender::writeAll(const char* data, size_t len)
 {
-    for(auto &i : items_){
-        i->format(os, event);
+    uint64_t begin = LogMetrics::Now();
+    while(len > 0){
+        ssize_t n = ::write(fd_, data, len);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            return;
+        }
+        data += n;
+        len -= static_cast<size_t>(n);
     }
-    return os;
+    metrics_.add(LogMetrics::kWriteNs, LogMetrics::Now() - begin);
 }
 
-LogEvent::LogEvent(std::shared_ptr<Logger> logger, LogLevel::Level level, 
-    const char* filename, int32_t line, uint32_t elapse,
-    std::thread::id thread_id, uint32_t fiber_id, std::chrono::system_clock::time_point time, 
-    const std::string& thread_name):
-    logger_(logger),
-    level_(level),
-    filename_(filename),
-    line_(line),
-    elapse_(elapse),
-    threadId_(thread_id),
-    fiberId_(fiber_id),
-    time_(time),
-    threadName_(thread_name){
-
+FileLogAppender::FileLogAppender(const std::string &filename)
+    : FileLogAppender(filename, FlushPolicy())
+{
 }
 
-void LogEvent::format(const char *fmt, ...)
+FileLogAppender::FileLogAppender(const std::string &filename, const FlushPolicy& policy)
+    : filename_(filename), policy_(policy)
 {
-    va_list al;
-    va_start(al, fmt);
-    format(fmt, al);
-    va_end(al);
+    last_check_ = std::chrono::steady_clock::now();
+    reopenLocked();
+    // 定时写出只调用非虚的 writeLocked, 派生类析构期间回调也是安全的
+    FlushTimer::Instance().add(this, [this]{
+        std::lock_guard<std::mutex> lock(mutex_);
+        if(!timer_pending_ || policy_.interval.count() <= 0){
+            return FlushTimer::clock::time_point::max();
+        }
+        auto due = pending_since_ + policy_.interval;
+        if(FlushTimer::clock::now() < due){
+            return due;
+        }
+        if(fd_ >= 0){
+            writeLocked();
+        }
+        timer_pending_ = false;
+        return FlushTimer::clock::time_point::max();
+    });
+    CrashHandler::Register(this);
 }
 
-void LogEvent::format(const char* fmt, va_list al) {
-    // Compute the size of the buffer we need
-    va_list al_copy;
-    va_copy(al_copy, al);
-    int len = vsnprintf(nullptr, 0, fmt, al_copy);
-    va_end(al_copy);
-
-    if (len < 0) {
-        return;
+FileLogAppender::~FileLogAppender()
+{
+    CrashHandler::Unregister(this);
+    FlushTimer::Instance().remove(this);
+    flushLocked();
+    if(fd_ >= 0){
+        ::close(fd_);
     }
+}
 
-    size_t size = static_cast<size_t>(len) + 1;
-    char* buf = new char[size];
-
-    vsnprintf(buf, size, fmt, al);
+void FileLogAppender::log(LogEvent::ptr event)
+{
+    auto lock = lockMetered();
+    appendLocked(*event);
+}
 
-    ss_content_ << std::string(buf, len);
-    delete[] buf;
+void FileLogAppender::logFormatted(const LogEvent& event, std::string_view text)
+{
+    auto lock = lockMetered();
+    buffer_.append(text);
+    commitLocked(text.size(), event.getLevel());
 }
 
-Logger::Logger(LogLevel::Level level, const std::string & name) : name_(name), level_(level)
+void FileLogAppender::appendLocked(const LogEvent& event)
 {
-    formatter_.reset(new LogFormatter("%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n"));
+    size_t size = buffer_.size();
+    uint64_t begin = LogMetrics::Now();
+    formatter_->format(buffer_, event);
+    metrics_.add(LogMetrics::kFormatNs, LogMetrics::Now() - begin);
+    commitLocked(buffer_.size() - size, event.getLevel());
 }
 
-void Logger::log(LogEvent::ptr event)
+void FileLogAppender::commitLocked(size_t bytes, LogLevel::Level level)
 {
-    mutex_.lock();
-    if(level_ <= event->getLevel()){
-        if(!appenders_.empty())
-            for(auto& i : appenders_){
-                i->log(event);
-            }
-        else if(root_){
-            root_->log(event);
-        }
+    file_size_ += bytes;
+    metrics_.add(LogMetrics::kBytes, bytes);
+    if(buffer_.size() >= policy_.bytes || level >= policy_.level || policy_.interval.count() == 0){
+        flushLocked();
+    }
+    else if(!timer_pending_ && policy_.interval.count() > 0){
+        // 缓冲中最早的内容最迟在 interval 后由后台定时器写出
+        timer_pending_ = true;
+        pending_since_ = std::chrono::steady_clock::now();
+        FlushTimer::Instance().schedule(this, pending_since_ + policy_.interval);
     }
-    mutex_.unlock();
 }
 
-void Logger::addAppender(LogAppender::ptr appender)
+void FileLogAppender::flush()
 {
-    mutex_.lock();
-    if(!appender->getFormatter()){
-        appender->setFormatter(formatter_);
-    }
-    appenders_.emplace_back(appender);
-    mutex_.unlock();
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushLocked();
 }
 
-void Logger::delAppender(LogAppender::ptr appender)
+void FileLogAppender::drain()
 {
-    mutex_.lock();
-    for(auto it = appenders_.begin(); it != appenders_.end(); ++it){
-        if(*it == appender){
-            appenders_.erase(it);
-            break;
-        }
+    if(fd_ >= 0){
+        DrainBuffer(fd_, buffer_);
     }
-    mutex_.unlock();
 }
 
-void Logger::clearAppender()
+bool FileLogAppender::reopen()
 {
-    mutex_.lock();
-    appenders_.clear();
-    mutex_.unlock();
+    std::lock_guard<std::mutex> lock(mutex_);
+    flushLocked();
+    return reopenLocked();
 }
 
-void Logger::addStdoutAppender()
+FileLogAppender::FlushPolicy FileLogAppender::getFlushPolicy()
 {
-    addAppender(stdout_appender_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    return policy_;
 }
 
-bool Logger::hasStdoutAppender() const
+void FileLogAppender::setFlushPolicy(const FlushPolicy& policy)
 {
-    for(auto& i : appenders_){
-        if(dynamic_cast<StdoutLogAppender*>(i.get())){
-            return true;
+    std::lock_guard<std::mutex> lock(mutex_);
+    policy_ = policy;
+    flushLocked();
+}
+
+bool FileLogAppender::flushLocked()
+{
+    auto now = std::chrono::steady_clock::now();
+    // 外部 logrotate 移走文件后, 下一次写出时切到新文件
+    if(now - last_check_ >= std::chrono::seconds(1)){
+        last_check_ = now;
+        if(isRotated()){
+            reopenLocked();
         }
     }
-    return false;
+    if(buffer_.empty()){
+        return true;
+    }
+    if(fd_ < 0 && !reopenLocked()){
+        buffer_.clear();
+        timer_pending_ = false;
+        return false;
+    }
+    return writeLocked();
 }
 
-void Logger::addFileAppender(const std::string &filename)
+bool FileLogAppender::writeLocked()
 {
-    addAppender(std::make_shared<FileLogAppender>(filename));
+    timer_pending_ = false;
+    uint64_t begin = LogMetrics::Now();
+    const char* p = buffer_.data();
+    size_t left = buffer_.size();
+    while(left > 0){
+        ssize_t n = ::write(fd_, p, left);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            std::cout << "FileLogAppender[" << filename_ << "] write error: " << std::strerror(errno) << std::endl;
+            break;
+        }
+        p += n;
+        left -= static_cast<size_t>(n);
+    }
+    metrics_.add(LogMetrics::kWriteNs, LogMetrics::Now() - begin);
+    buffer_.clear();
+    return left == 0;
 }
 
-void Logger::setFormatter(LogFormatter::ptr val)
+bool FileLogAppender::reopenLocked()
 {
-    formatter_ = val;
-    for(auto& i : appenders_){
-        if(!i->hasFormatter()){
-            i->setFormatter(formatter_);
-        }
+    if(fd_ >= 0){
+        ::close(fd_);
+    }
+    fd_ = ::open(filename_.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if(fd_ < 0){
+        std::cout << "FileLogAppender[" << filename_ << "] open error: " << std::strerror(errno) << std::endl;
+        return false;
     }
+    struct stat st;
+    if(::fstat(fd_, &st) == 0){
+        inode_ = st.st_ino;
+        device_ = st.st_dev;
+        file_size_ = static_cast<uint64_t>(st.st_size) + buffer_.size();
+    }
+    return true;
 }
 
-void Logger::setFormatter(std::string &val)
+bool FileLogAppender::isRotated()
 {
-    LogFormatter::ptr new_val(new LogFormatter(val));
-    if(new_val->isError()){
-        std::cout << "Logger setFormatter name=" << name_ << " value=" << val << " invalid formatter" << std::endl;
-        return;
+    if(fd_ < 0){
+        return true;
     }
-    formatter_ = new_val;
-    for(auto& i : appenders_){
-        if(!i->hasFormatter()){
-            i->setFormatter(formatter_);
-        }
+    struct stat st;
+    if(::stat(filename_.c_str(), &st) != 0){
+        return true;
     }
+    return static_cast<uint64_t>(st.st_ino) != inode_ || static_cast<uint64_t>(st.st_dev) != device_;
 }
 
-void LogAppender::setFormatter(LogFormatter::ptr val)
+void LoggerManager::addLogger(const std::string &name, LogLevel::Level level)
 {
-    if(!formatter_) hasFormatter_ = true;
-    formatter_ = val;
+    // 已作为祖先隐式创建的日志器补上显式级别
+    Logger::ptr logger = getOrCreate(name, level);
+    if(!logger->hasLevel()){
+        logger->setLevel(level);
+    }
 }
 
-LogFormatter::ptr LogAppender::getFormatter() const
+void LoggerManager::addLogger(const std::string &name, const std::string &level)
 {
-    return formatter_;
+    addLogger(name, LogLevel::FromString(level));
 }
 
-bool LogAppender::hasFormatter() const
+Logger::ptr LoggerManager::getLogger(const std::string &name)
 {
-    return hasFormatter_;
+    return getOrCreate(name, std::nullopt);
 }
 
-LogEventWrap::LogEventWrap(LogEvent::ptr e) : event_(e)
+Logger::ptr LoggerManager::getRoot() const
 {
+    return root_;
 }
 
-LogEventWrap::~LogEventWrap()
+LoggerManager::Shard& LoggerManager::getShard(const std::string& name)
 {
-    event_->getLogger()->log(event_);
+    return shards_[std::hash<std::string>()(name) % kShards];
 }
 
-void StdoutLogAppender::log(LogEvent::ptr event)
+Logger::ptr LoggerManager::getOrCreate(const std::string& name, std::optional<LogLevel::Level> level)
 {
-    mutex_.lock();
-    formatter_->format(std::cout, event);
-    mutex_.unlock();
+    Shard& shard = getShard(name);
+    {
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        auto it = shard.loggers.find(name);
+        if(it != shard.loggers.end()){
+            return it->second;
+        }
+    }
+    // 先保证父节点存在, 缺失的祖先继承级别
+    Logger::ptr parent = root_;
+    size_t dot = name.rfind('.');
+    if(dot != std::string::npos && dot > 0){
+        parent = getOrCreate(name.substr(0, dot), std::nullopt);
+    }
+
+    std::unique_lock<std::shared_mutex> lock(shard.mutex);
+    auto it = shard.loggers.find(name);
+    if(it == shard.loggers.end()){
+        auto logger = std::make_shared<Logger>(level.value_or(LogLevel::Level::debug), name);
+        // 在分片锁内挂到父节点, 其他线程查到时层级已经建立
+        std::lock_guard<std::mutex> hierarchy(Logger::HierarchyMutex());
+        logger->level_set_ = level.has_value();
+        logger->setParentLocked(parent);
+        it = shard.loggers.emplace(name, logger).first;
+    }
+    return it->second;
 }
 
-FileLogAppender::FileLogAppender(const std::string &filename) : filename_(filename)
+LoggerManager::LoggerManager() : root_(std::make_shared<Logger>())
 {
-    reopen();
+    getShard(root_->getName()).loggers[root_->getName()] = root_;
 }
 
-void FileLogAppender::log(LogEvent::ptr event)
+LoggerManager::~LoggerManager()
 {
-    auto now = event->getTime();
-    if(now != last_time_){
-        reopen();
-        last_time_ = now;
-    }
-    mutex_.lock();
-    if(!formatter_->format(ofs_, event)){
-        std::cout << "LogAppender[" << filename_ << "] format error" << std::endl;
-    }
-    mutex_.unlock();
+    stopMetricsReport();
 }
 
-bool FileLogAppender::reopen()
+std::vector<Logger::ptr> LoggerManager::getLoggers()
 {
-    if(ofs_.is_open()){
-        ofs_.close();
+    std::vector<Logger::ptr> loggers;
+    for(auto& shard : shards_){
+        std::shared_lock<std::shared_mutex> lock(shard.mutex);
+        for(auto& i : shard.loggers){
+            loggers.push_back(i.second);
+        }
     }
-    ofs_.open(filename_, std::ios::app);
-    return ofs_.is_open();
+    return loggers;
 }
 
-void LoggerManager::addLogger(const std::string &name, LogLevel::Level level)
+void LoggerManager::flushAll()
 {
-    if(loggers_.find(name) != loggers_.end()){
-        return;
-    }
-    else {
-        loggers_[name] = std::make_shared<Logger>(level, name);
+    std::vector<LogAppender*> seen;
+    for(auto& logger : getLoggers()){
+        for(auto& appender : logger->getAppenders()){
+            if(std::find(seen.begin(), seen.end(), appender.get()) != seen.end()){
+                continue;
+            }
+            seen.push_back(appender.get());
+            appender->flush();
+        }
     }
 }
 
-void LoggerManager::addLogger(const std::string &name, const std::string &level)
+LogMetrics LoggerManager::getMetrics()
 {
-    if(loggers_.find(name) != loggers_.end()){
-        return;
-    }
-    else {
-        loggers_[name] = std::make_shared<Logger>(LogLevel::FromString(level), name);
+    LogMetrics metrics;
+    std::vector<Logger::ptr> loggers = getLoggers();
+    std::sort(loggers.begin(), loggers.end(), [](const Logger::ptr& a, const Logger::ptr& b){
+        return a->getName() < b->getName();
+    });
+
+    std::vector<LogAppender*> seen;
+    for(auto& logger : loggers){
+        metrics.loggers.emplace_back();
+        logger->collectMetrics(metrics.loggers.back());
+        for(auto& appender : logger->getAppenders()){
+            if(std::find(seen.begin(), seen.end(), appender.get()) != seen.end()){
+                continue;
+            }
+            seen.push_back(appender.get());
+            metrics.appenders.emplace_back();
+            appender->collectMetrics(metrics.appenders.back());
+        }
     }
+    return metrics;
 }
 
-Logger::ptr LoggerManager::getLogger(const std::string &name)
+void LoggerManager::startMetricsReport(Logger::ptr target, std::chrono::milliseconds interval)
 {
-    auto it = loggers_.find(name);
-    if(it == loggers_.end()){
-        this->addLogger(name, LogLevel::Level::debug);
-        it = loggers_.find(name);
-        return it->second;
-    }
-    return it->second;
+    stopMetricsReport();
+    std::lock_guard<std::mutex> lock(report_mutex_);
+    report_stop_ = false;
+    report_thread_ = std::thread([this, target, interval]{
+        std::unique_lock<std::mutex> lock(report_mutex_);
+        while(!report_cv_.wait_for(lock, interval, [this]{ return report_stop_; })){
+            lock.unlock();
+            reportMetrics(target.get());
+            lock.lock();
+        }
+    });
 }
 
-Logger::ptr LoggerManager::getRoot() const
+void LoggerManager::stopMetricsReport()
 {
-    return root_;
+    std::thread thread;
+    {
+        std::lock_guard<std::mutex> lock(report_mutex_);
+        report_stop_ = true;
+        report_cv_.notify_all();
+        thread.swap(report_thread_);
+    }
+    if(thread.joinable()){
+        thread.join();
+    }
 }
 
-LoggerManager::LoggerManager() : root_(std::make_shared<Logger>())
+void LoggerManager::reportMetrics(Logger* target)
 {
-    loggers_[root_->getName()] = root_;
+    LogMetrics metrics = getMetrics();
+    for(auto& i : metrics.loggers){
+        uint64_t emitted = 0;
+        for(auto n : i.emitted){
+            emitted += n;
+        }
+        if(emitted == 0 && i.filtered == 0){
+            continue;
+        }
+        LOG4CPP_INFO(target, "metrics logger={} debug={} info={} warn={} error={} fatal={} filtered={}",
+                i.name, i.emitted[1], i.emitted[2], i.emitted[3], i.emitted[4], i.emitted[5], i.filtered);
+    }
+    for(auto& i : metrics.appenders){
+        LOG4CPP_INFO(target, "metrics appender={} events={} bytes={} format_us={} write_us={} lock_wait_us={} queue={} dropped={}",
+                i.name, i.events, i.bytes, i.format_ns / 1000, i.write_ns / 1000, i.lock_wait_ns / 1000,
+                i.queue_depth, i.dropped);
+    }
 }
 
 StdoutLogAppender::ptr Logger::stdout_appender_ = std::make_shared<StdoutLogAppender>();
@@ -0,0 +1,381 @@
+#include "mmap.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+#include <filesystem>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+namespace log4cpp{
+
+namespace fs = std::filesystem;
+
+MmapFileAppender::MmapFileAppender(const std::string& basename, size_t segment_size)
+    : basename_(basename), segment_size_(segment_size)
+{
+    if(segment_size_ < 4096){
+        segment_size_ = 4096;
+    }
+    // 从已有段的最大序号之后开始
+    uint64_t index = 0;
+    fs::path base(basename_);
+    fs::path dir = base.has_parent_path() ? base.parent_path() : fs::path(".");
+    std::string prefix = base.filename().string() + ".";
+    std::error_code ec;
+    for(auto& entry : fs::directory_iterator(dir, ec)){
+        std::string name = entry.path().filename().string();
+        if(name.size() > prefix.size() && name.compare(0, prefix.size(), prefix) == 0){
+            std::string suffix = name.substr(prefix.size());
+            if(suffix.find_first_not_of("0123456789") == std::string::npos){
+                index = std::max<uint64_t>(index, std::stoull(suffix));
+            }
+        }
+    }
+    {
+        std::unique_lock<std::mutex> lock(roll_mutex_);
+        next_index_ = index + 1;
+        // 第一段同步建立, 之后的段由后台线程预建
+        auto segment = createSegment(next_index_, true);
+        if(segment){
+            index_.store(next_index_++, std::memory_order_release);
+            current_.store(segment.get());
+            segments_.push_back(std::move(segment));
+        }
+        else{
+            openFallbackLocked();
+        }
+    }
+    worker_ = std::thread(&MmapFileAppender::run, this);
+}
+
+MmapFileAppender::~MmapFileAppender()
+{
+    {
+        std::lock_guard<std::mutex> lock(roll_mutex_);
+        stopping_ = true;
+        cv_.notify_all();
+    }
+    if(worker_.joinable()){
+        worker_.join();
+    }
+    std::lock_guard<std::mutex> lock(roll_mutex_);
+    Segment* segment = current_.exchange(nullptr);
+    if(segment){
+        segment->used = std::min(segment->offset.load(), segment->size);
+        segment->sealed.store(true);
+        retire(segment);
+    }
+    for(Segment* retired : retired_){
+        retire(retired);
+    }
+    // 未用到的预建段不留在磁盘上
+    if(spare_){
+        ::munmap(spare_->data, spare_->size);
+        ::close(spare_->fd);
+        ::unlink(spare_->path.c_str());
+    }
+    if(fallback_fd_ >= 0){
+        ::close(fallback_fd_);
+    }
+}
+
+void MmapFileAppender::log(LogEvent::ptr event)
+{
+    thread_local LogBuffer t_line;
+    t_line.clear();
+    LogFormatter::ptr formatter = getFormatter();
+    uint64_t begin = LogMetrics::Now();
+    formatter->format(t_line, *event);
+    metrics_.add(LogMetrics::kFormatNs, LogMetrics::Now() - begin);
+    write(t_line.view());
+}
+
+void MmapFileAppender::logFormatted(const LogEvent& /*event*/, std::string_view text)
+{
+    write(text);
+}
+
+void MmapFileAppender::write(std::string_view line)
+{
+    size_t len = std::min(line.size(), segment_size_);
+    metrics_.add(LogMetrics::kBytes, len);
+
+    for(;;){
+        // 先登记为当前纪元的写者再读 current_, 纪元已变化时重新登记
+        uint64_t epoch = epoch_.load();
+        std::atomic<uint64_t>& readers = readers_[epoch & 1].count;
+        readers.fetch_add(1);
+        if(epoch_.load() != epoch){
+            readers.fetch_sub(1, std::memory_order_release);
+            continue;
+        }
+        Segment* segment = current_.load();
+        if(!segment){
+            readers.fetch_sub(1, std::memory_order_release);
+            if(writeFallback(line.substr(0, len))){
+                return;
+            }
+            continue;
+        }
+        if(segment->sealed.load(std::memory_order_acquire)){
+            readers.fetch_sub(1, std::memory_order_release);
+            std::this_thread::yield();
+            continue;
+        }
+
+        size_t offset = segment->offset.fetch_add(len, std::memory_order_relaxed);
+        if(offset + len <= segment->size){
+            std::memcpy(segment->data + offset, line.data(), len);
+            readers.fetch_sub(1, std::memory_order_release);
+            return;
+        }
+        // 跨越段尾的写者负责换段, 其余写者等新段发布后重试;
+        // 退出登记后只有跨越者还能访问该段: 换段之前它仍是当前段, 不会被后台线程回收
+        bool crossing = offset <= segment->size;
+        readers.fetch_sub(1, std::memory_order_release);
+        if(crossing){
+            roll(segment, offset);
+        }
+        std::this_thread::yield();
+    }
+}
+
+bool MmapFileAppender::writeFallback(std::string_view line)
+{
+    std::unique_lock<std::mutex> lock(roll_mutex_);
+    if(current_.load()){
+        return false;
+    }
+    if(fallback_fd_ < 0){
+        if(std::chrono::steady_clock::now() < retry_at_){
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+        advanceLocked(lock);
+        if(current_.load()){
+            return false;
+        }
+        if(fallback_fd_ < 0){
+            dropped_.fetch_add(1, std::memory_order_relaxed);
+            return true;
+        }
+    }
+    const char* data = line.data();
+    size_t left = line.size();
+    while(left > 0){
+        ssize_t n = ::write(fallback_fd_, data, left);
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            break;
+        }
+        data += n;
+        left -= static_cast<size_t>(n);
+    }
+    if(left > 0){
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+    }
+    fallback_bytes_ += line.size() - left;
+    // 写满一段后换到下一段, 优先使用后台线程预建成功的映射段
+    if(fallback_bytes_ >= segment_size_){
+        ::close(fallback_fd_);
+        fallback_fd_ = -1;
+        advanceLocked(lock);
+    }
+    return true;
+}
+
+void MmapFileAppender::flush()
+{
+    std::lock_guard<std::mutex> lock(roll_mutex_);
+    Segment* segment = current_.load(std::memory_order_acquire);
+    if(segment){
+        size_t used = std::min(segment->offset.load(), segment->size);
+        ::msync(segment->data, used, MS_ASYNC);
+    }
+}
+
+void MmapFileAppender::collectMetrics(LogMetrics::AppenderStats& stats) const
+{
+    LogAppender::collectMetrics(stats);
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+}
+
+std::string MmapFileAppender::segmentPath(uint64_t index) const
+{
+    char suffix[32];
+    std::snprintf(suffix, sizeof(suffix), ".%06llu", static_cast<unsigned long long>(index));
+    return basename_ + suffix;
+}
+
+std::unique_ptr<MmapFileAppender::Segment> MmapFileAppender::createSegment(uint64_t index, bool report)
+{
+    std::unique_ptr<Segment> segment(new Segment);
+    segment->path = segmentPath(index);
+    segment->index = index;
+    segment->size = segment_size_;
+    segment->fd = ::open(segment->path.c_str(), O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(segment->fd < 0){
+        if(report){
+            std::cout << "MmapFileAppender[" << segment->path << "] open error: " << std::strerror(errno) << std::endl;
+        }
+        return nullptr;
+    }
+    // 不退回到 ftruncate: 稀疏文件在磁盘写满时写映射区会触发 SIGBUS
+    int err = ::posix_fallocate(segment->fd, 0, static_cast<off_t>(segment->size));
+    void* data = err == 0 ? ::mmap(nullptr, segment->size, PROT_READ | PROT_WRITE, MAP_SHARED, segment->fd, 0)
+                          : MAP_FAILED;
+    if(data == MAP_FAILED){
+        if(err == 0){
+            err = errno;
+        }
+        if(report){
+            std::cout << "MmapFileAppender[" << segment->path << "] preallocate error: " << std::strerror(err) << std::endl;
+        }
+        ::close(segment->fd);
+        ::unlink(segment->path.c_str());
+        return nullptr;
+    }
+    segment->data = static_cast<char*>(data);
+    return segment;
+}
+
+void MmapFileAppender::roll(Segment* segment, size_t used)
+{
+    std::unique_lock<std::mutex> lock(roll_mutex_);
+    if(current_.load() != segment || segment->sealed.load()){
+        return;
+    }
+    segment->used = used;
+    segment->sealed.store(true, std::memory_order_release);
+    advanceLocked(lock);
+    // 换下之后才交给后台线程, 之前它仍可能被写者读到
+    retired_.push_back(segment);
+    cv_.notify_all();
+}
+
+void MmapFileAppender::advanceLocked(std::unique_lock<std::mutex>& lock)
+{
+    // 后台线程正在建的就是下一段, 等它完成而不是重复创建同名文件
+    cv_.wait(lock, [this]{ return !preparing_; });
+    if(!spare_ && std::chrono::steady_clock::now() >= retry_at_){
+        // 后台线程还没来得及预建时在这里同步建立, 失败后在重试间隔内直接走 write(2)
+        auto segment = createSegment(next_index_, !failing_);
+        if(segment){
+            spare_ = segment.get();
+            segments_.push_back(std::move(segment));
+        }
+        else{
+            failing_ = true;
+            retry_at_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+        }
+    }
+    if(spare_){
+        Segment* next = spare_;
+        spare_ = nullptr;
+        ++next_index_;
+        failing_ = false;
+        index_.store(next->index, std::memory_order_release);
+        current_.store(next);
+    }
+    else{
+        openFallbackLocked();
+    }
+    cv_.notify_all();
+}
+
+void MmapFileAppender::openFallbackLocked()
+{
+    uint64_t index = next_index_++;
+    std::string path = segmentPath(index);
+    current_.store(nullptr);
+    index_.store(index, std::memory_order_release);
+    fallback_bytes_ = 0;
+    fallback_fd_ = ::open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if(fallback_fd_ < 0){
+        retry_at_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    }
+    if(!failing_){
+        if(fallback_fd_ < 0){
+            std::cout << "MmapFileAppender[" << path << "] open error: " << std::strerror(errno) << std::endl;
+        }
+        else{
+            std::cout << "MmapFileAppender[" << path << "] no preallocated segment, falling back to write(2)" << std::endl;
+        }
+        failing_ = true;
+    }
+}
+
+void MmapFileAppender::run()
+{
+    std::unique_lock<std::mutex> lock(roll_mutex_);
+    for(;;){
+        if(!retired_.empty()){
+            std::vector<Segment*> retired;
+            retired.swap(retired_);
+            lock.unlock();
+            waitReaders();
+            for(Segment* segment : retired){
+                retire(segment);
+            }
+            lock.lock();
+            std::erase_if(segments_, [&retired](const std::unique_ptr<Segment>& segment){
+                return std::find(retired.begin(), retired.end(), segment.get()) != retired.end();
+            });
+            continue;
+        }
+        if(stopping_){
+            return;
+        }
+        if(!spare_ && std::chrono::steady_clock::now() >= retry_at_){
+            uint64_t index = next_index_;
+            bool report = !failing_;
+            preparing_ = true;
+            lock.unlock();
+            auto segment = createSegment(index, report);
+            lock.lock();
+            preparing_ = false;
+            if(segment){
+                spare_ = segment.get();
+                segments_.push_back(std::move(segment));
+            }
+            else{
+                failing_ = true;
+                retry_at_ = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+            }
+            cv_.notify_all();
+            continue;
+        }
+        if(spare_){
+            cv_.wait(lock);
+        }
+        else{
+            cv_.wait_until(lock, retry_at_);
+        }
+    }
+}
+
+void MmapFileAppender::waitReaders()
+{
+    // 推进纪元后, 之后登记的写者只会读到新的 current_; 等旧纪元的写者全部退出
+    uint64_t epoch = epoch_.fetch_add(1);
+    while(readers_[epoch & 1].count.load(std::memory_order_acquire) != 0){
+        std::this_thread::yield();
+    }
+}
+
+void MmapFileAppender::retire(Segment* segment)
+{
+    ::munmap(segment->data, segment->size);
+    segment->data = nullptr;
+    if(::ftruncate(segment->fd, static_cast<off_t>(segment->used)) != 0){
+        std::cout << "MmapFileAppender[" << segment->path << "] truncate error: " << std::strerror(errno) << std::endl;
+    }
+    ::close(segment->fd);
+    segment->fd = -1;
+}
+
+} // namespace log4cpp
@@ -0,0 +1,331 @@
+#include "rolling.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstring>
+#include <ctime>
+#include <filesystem>
+#include <fcntl.h>
+#include <signal.h>
+#include <unistd.h>
+
+#ifdef LOG4CPP_HAVE_ZLIB
+#include <zlib.h>
+#endif
+
+namespace log4cpp{
+
+namespace fs = std::filesystem;
+
+RollingFileAppender::RollingFileAppender(const std::string& filename)
+    : RollingFileAppender(filename, Options())
+{
+}
+
+RollingFileAppender::RollingFileAppender(const std::string& filename, const Options& options)
+    : FileLogAppender(filename, options.flush), options_(options)
+{
+    if(options_.compression != Compression::none && !CompressionAvailable(options_.compression)){
+        std::cout << "RollingFileAppender[" << filename_ << "] built without zlib, compression disabled" << std::endl;
+        options_.compression = Compression::none;
+    }
+    segment_start_ = std::chrono::system_clock::now();
+    scheduleRollLocked(segment_start_);
+    worker_ = std::thread(&RollingFileAppender::run, this);
+    // 启动时收尾上次进程遗留的待归档文件, 并按保留策略清理一次旧归档
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.push_back({std::string(), segment_start_, true});
+    jobs_cv_.notify_one();
+}
+
+bool RollingFileAppender::CompressionAvailable(Compression compression)
+{
+#ifdef LOG4CPP_HAVE_ZLIB
+    return compression == Compression::none || compression == Compression::gzip;
+#else
+    return compression == Compression::none;
+#endif
+}
+
+RollingFileAppender::~RollingFileAppender()
+{
+    {
+        std::lock_guard<std::mutex> lock(jobs_mutex_);
+        stopping_ = true;
+        jobs_cv_.notify_one();
+    }
+    if(worker_.joinable()){
+        worker_.join();
+    }
+}
+
+void RollingFileAppender::log(LogEvent::ptr event)
+{
+    auto lock = lockMetered();
+    time_point now = event->getTime();
+    if(options_.interval.count() > 0 && now >= next_roll_){
+        rollLocked(now);
+    }
+    appendLocked(*event);
+    if(options_.max_bytes > 0 && file_size_ >= options_.max_bytes){
+        rollLocked(now);
+    }
+}
+
+void RollingFileAppender::logFormatted(const LogEvent& event, std::string_view text)
+{
+    auto lock = lockMetered();
+    time_point now = event.getTime();
+    if(options_.interval.count() > 0 && now >= next_roll_){
+        rollLocked(now);
+    }
+    buffer_.append(text);
+    commitLocked(text.size(), event.getLevel());
+    if(options_.max_bytes > 0 && file_size_ >= options_.max_bytes){
+        rollLocked(now);
+    }
+}
+
+void RollingFileAppender::roll()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    rollLocked(std::chrono::system_clock::now());
+}
+
+void RollingFileAppender::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(jobs_mutex_);
+    jobs_cv_.wait(lock, [this]{ return jobs_.empty() && !busy_; });
+}
+
+void RollingFileAppender::rollLocked(time_point now)
+{
+    flushLocked();
+    // 这里只改名为不会重名的临时文件, 查重与定名交给后台线程
+    std::string staged = filename_ + "." + std::to_string(::getpid()) + "." + std::to_string(++roll_seq_) + ".roll";
+    if(::rename(filename_.c_str(), staged.c_str()) != 0){
+        std::cout << "RollingFileAppender[" << filename_ << "] rename error: " << std::strerror(errno) << std::endl;
+        staged.clear();
+    }
+    reopenLocked();
+    time_point start = segment_start_;
+    segment_start_ = now;
+    scheduleRollLocked(now);
+
+    std::lock_guard<std::mutex> lock(jobs_mutex_);
+    jobs_.push_back({std::move(staged), start, false});
+    jobs_cv_.notify_one();
+}
+
+void RollingFileAppender::scheduleRollLocked(time_point now)
+{
+    if(options_.interval.count() <= 0){
+        return;
+    }
+    // 对齐到本地时间的整周期, 如按天滚动时在本地零点切换
+    std::time_t t = std::chrono::system_clock::to_time_t(now);
+    std::tm tm;
+    localtime_r(&t, &tm);
+    int64_t offset = tm.tm_gmtoff;
+    int64_t interval = options_.interval.count();
+    int64_t local = static_cast<int64_t>(t) + offset;
+    int64_t next = (local / interval + 1) * interval - offset;
+    next_roll_ = std::chrono::system_clock::from_time_t(static_cast<std::time_t>(next));
+}
+
+std::string RollingFileAppender::archiveName(time_point start) const
+{
+    std::time_t t = std::chrono::system_clock::to_time_t(start);
+    std::tm tm;
+    localtime_r(&t, &tm);
+    char suffix[128];
+    size_t n = std::strftime(suffix, sizeof(suffix), options_.pattern.c_str(), &tm);
+    std::string base = filename_ + "." + std::string(suffix, n);
+    std::string name = base;
+    for(int i=1; fs::exists(name) || fs::exists(name + ".gz"); ++i){
+        name = base + "." + std::to_string(i);
+    }
+    return name;
+}
+
+bool RollingFileAppender::isArchiveName(const std::string& name, const std::string& prefix) const
+{
+    if(name.size() <= prefix.size() || name.compare(0, prefix.size(), prefix) != 0){
+        return false;
+    }
+    // 形如 strftime(pattern) [".N"] [".gz"], 与 archiveName 生成的名称一致
+    std::string suffix = name.substr(prefix.size());
+    std::tm tm{};
+    const char* end = ::strptime(suffix.c_str(), options_.pattern.c_str(), &tm);
+    if(end == nullptr || end == suffix.c_str()){
+        return false;
+    }
+    std::string_view tail(end);
+    if(tail.size() >= 3 && tail.substr(tail.size() - 3) == ".gz"){
+        tail.remove_suffix(3);
+    }
+    if(tail.empty()){
+        return true;
+    }
+    if(tail.size() < 2 || tail[0] != '.'){
+        return false;
+    }
+    return std::all_of(tail.begin() + 1, tail.end(), [](char c){ return c >= '0' && c <= '9'; });
+}
+
+void RollingFileAppender::archive(const std::string& staged, time_point start)
+{
+    std::string name = archiveName(start);
+    if(::rename(staged.c_str(), name.c_str()) != 0){
+        std::cout << "RollingFileAppender[" << staged << "] rename error: " << std::strerror(errno) << std::endl;
+        return;
+    }
+    if(options_.compression != Compression::none){
+        compress(name);
+    }
+}
+
+void RollingFileAppender::adoptStaged()
+{
+    // 进程在改名之后、后台定名之前退出时会留下 "<filename>.<pid>.<seq>.roll".
+    // 只接管写入进程已经退出的文件: 仍在运行的进程(包括本进程)会自己完成归档
+    fs::path active(filename_);
+    fs::path dir = active.has_parent_path() ? active.parent_path() : fs::path(".");
+    std::string prefix = active.filename().string() + ".";
+    std::vector<fs::path> staged;
+    std::error_code ec;
+    for(auto& entry : fs::directory_iterator(dir, ec)){
+        std::string name = entry.path().filename().string();
+        if(name.size() <= prefix.size() + 5 || name.compare(0, prefix.size(), prefix) != 0
+                || name.compare(name.size() - 5, 5, ".roll") != 0){
+            continue;
+        }
+        std::string_view middle(name.data() + prefix.size(), name.size() - prefix.size() - 5);
+        size_t dot = middle.find('.');
+        pid_t pid = 0;
+        auto r = std::from_chars(middle.data(), middle.data() + dot, pid);
+        if(dot == std::string_view::npos || r.ec != std::errc() || r.ptr != middle.data() + dot || pid <= 0
+                || pid == ::getpid() || ::kill(pid, 0) == 0 || errno != ESRCH){
+            continue;
+        }
+        if(entry.is_regular_file(ec)){
+            staged.push_back(entry.path());
+        }
+    }
+    for(auto& path : staged){
+        auto mtime = fs::last_write_time(path, ec);
+        if(ec){
+            continue;
+        }
+        auto start = std::chrono::time_point_cast<time_point::duration>(fs::file_time_type::clock::to_sys(mtime));
+        archive(path.string(), start);
+    }
+}
+
+void RollingFileAppender::run()
+{
+    for(;;){
+        Job job;
+        {
+            std::unique_lock<std::mutex> lock(jobs_mutex_);
+            busy_ = false;
+            jobs_cv_.notify_all();
+            jobs_cv_.wait(lock, [this]{ return stopping_ || !jobs_.empty(); });
+            if(jobs_.empty()){
+                return;
+            }
+            job = std::move(jobs_.front());
+            jobs_.pop_front();
+            busy_ = true;
+        }
+        if(job.startup){
+            adoptStaged();
+        }
+        if(!job.staged.empty()){
+            archive(job.staged, job.start);
+        }
+        enforceRetention();
+    }
+}
+
+void RollingFileAppender::compress(const std::string& path)
+{
+#ifdef LOG4CPP_HAVE_ZLIB
+    std::string target = path + ".gz";
+    std::string tmp = target + ".tmp";
+    int fd = ::open(path.c_str(), O_RDONLY | O_CLOEXEC);
+    if(fd < 0){
+        return;
+    }
+    gzFile gz = gzopen(tmp.c_str(), "wb6");
+    bool ok = gz != nullptr;
+    char buf[64 * 1024];
+    ssize_t n;
+    while(ok && (n = ::read(fd, buf, sizeof(buf))) != 0){
+        if(n < 0){
+            if(errno == EINTR){
+                continue;
+            }
+            ok = false;
+            break;
+        }
+        ok = gzwrite(gz, buf, static_cast<unsigned>(n)) == n;
+    }
+    ::close(fd);
+    if(gz && gzclose(gz) != Z_OK){
+        ok = false;
+    }
+    if(ok && ::rename(tmp.c_str(), target.c_str()) == 0){
+        ::unlink(path.c_str());
+    }
+    else{
+        std::cout << "RollingFileAppender[" << path << "] compress error" << std::endl;
+        ::unlink(tmp.c_str());
+    }
+#else
+    (void)path;
+#endif
+}
+
+void RollingFileAppender::enforceRetention()
+{
+    if(options_.max_files == 0 && options_.max_total_bytes == 0){
+        return;
+    }
+    fs::path active(filename_);
+    fs::path dir = active.has_parent_path() ? active.parent_path() : fs::path(".");
+    std::string prefix = active.filename().string() + ".";
+
+    struct Archive{
+        fs::path path;
+        fs::file_time_type mtime;
+        uint64_t size;
+    };
+    std::vector<Archive> archives;
+    std::error_code ec;
+    for(auto& entry : fs::directory_iterator(dir, ec)){
+        if(!isArchiveName(entry.path().filename().string(), prefix)){
+            continue;
+        }
+        if(!entry.is_regular_file(ec)){
+            continue;
+        }
+        archives.push_back({entry.path(), entry.last_write_time(ec), entry.file_size(ec)});
+    }
+    // 新的在前
+    std::sort(archives.begin(), archives.end(), [](const Archive& a, const Archive& b){
+        return a.mtime != b.mtime ? a.mtime > b.mtime : a.path.filename() > b.path.filename();
+    });
+
+    uint64_t total = 0;
+    for(size_t i=0; i<archives.size(); ++i){
+        total += archives[i].size;
+        bool over_count = options_.max_files > 0 && i >= options_.max_files;
+        bool over_bytes = options_.max_total_bytes > 0 && total > options_.max_total_bytes;
+        if(over_count || over_bytes){
+            fs::remove(archives[i].path, ec);
+        }
+    }
+}
+
+} // namespace log4cpp
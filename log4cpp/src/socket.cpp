@@ -0,0 +1,467 @@
+#include "socket.hpp"
+#include "crash.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
+namespace log4cpp{
+
+namespace {
+
+constexpr size_t kMaxMessages = 64;                                 // 每次 sendmmsg 最多发出的数据报数
+constexpr std::chrono::milliseconds kRetryDelay{10};                // 发送缓冲满时的重试间隔
+
+// 日志级别对应的 syslog severity
+int SyslogSeverity(LogLevel::Level level)
+{
+    switch(level){
+    case LogLevel::Level::debug: return 7;
+    case LogLevel::Level::info: return 6;
+    case LogLevel::Level::warn: return 4;
+    case LogLevel::Level::error: return 3;
+    case LogLevel::Level::fatal: return 2;
+    default: return 5;
+    }
+}
+
+// RFC 5424 的 HOSTNAME/APP-NAME: 可见 ASCII, 不超过 limit 字节, 为空时为 "-"
+std::string SyslogField(std::string_view str, size_t limit)
+{
+    std::string field;
+    for(char c : str.substr(0, limit)){
+        field.push_back(c > ' ' && c < 127 ? c : '_');
+    }
+    return field.empty() ? "-" : field;
+}
+
+bool ConnectTimeout(int fd, const sockaddr* addr, socklen_t len, std::chrono::milliseconds timeout)
+{
+    if(::connect(fd, addr, len) == 0){
+        return true;
+    }
+    if(errno != EINPROGRESS){
+        return false;
+    }
+    pollfd pfd{fd, POLLOUT, 0};
+    if(::poll(&pfd, 1, static_cast<int>(timeout.count())) <= 0){
+        return false;
+    }
+    int error = 0;
+    socklen_t size = sizeof(error);
+    return ::getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &size) == 0 && error == 0;
+}
+
+} // namespace
+
+SocketLogAppender::SocketLogAppender(const Options& options)
+    : options_(options)
+    , backoff_(options.reconnect_min)
+{
+    char host[256] = {0};
+    if(::gethostname(host, sizeof(host) - 1) != 0){
+        host[0] = '\0';
+    }
+    hostname_ = SyslogField(host, 255);
+    app_name_ = SyslogField(options_.app_name.empty() ? program_invocation_short_name : options_.app_name, 48);
+    procid_ = std::to_string(::getpid());
+    if(options_.syslog){
+        // 时间与级别已在报文头中
+        setFormatter(std::make_shared<LogFormatter>("%m"));
+    }
+    last_send_ = std::chrono::steady_clock::now();
+    CrashHandler::Register(this);
+    sender_ = std::thread(&SocketLogAppender::run, this);
+}
+
+SocketLogAppender::~SocketLogAppender()
+{
+    CrashHandler::Unregister(this);
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        running_ = false;
+    }
+    cv_.notify_all();
+    sender_.join();
+    disconnect();
+}
+
+std::string SocketLogAppender::getName() const
+{
+    switch(options_.protocol){
+    case Protocol::udp: return "udp:" + options_.address + ":" + std::to_string(options_.port);
+    case Protocol::tcp: return "tcp:" + options_.address + ":" + std::to_string(options_.port);
+    default: return "unix:" + options_.address;
+    }
+}
+
+void SocketLogAppender::log(LogEvent::ptr event)
+{
+    thread_local LogBuffer t_line;
+    t_line.clear();
+    LogFormatter::ptr formatter = getFormatter();
+    uint64_t begin = LogMetrics::Now();
+    formatter->format(t_line, *event);
+    metrics_.add(LogMetrics::kFormatNs, LogMetrics::Now() - begin);
+    append(*event, t_line.view());
+}
+
+void SocketLogAppender::logFormatted(const LogEvent& event, std::string_view text)
+{
+    append(event, text);
+}
+
+void SocketLogAppender::append(const LogEvent& event, std::string_view text)
+{
+    thread_local LogBuffer t_record;
+    t_record.clear();
+    char prefix[24];
+    size_t prefix_len = 0;
+    if(options_.syslog){
+        if(!text.empty() && text.back() == '\n'){
+            text.remove_suffix(1);
+        }
+        appendSyslogHeader(t_record, event);
+        t_record.append(text);
+        text = t_record.view();
+        if(options_.protocol == Protocol::tcp){
+            // RFC 6587 octet counting
+            char* end = std::to_chars(prefix, prefix + sizeof(prefix) - 1, text.size()).ptr;
+            *end++ = ' ';
+            prefix_len = end - prefix;
+        }
+    }
+    size_t size = prefix_len + text.size();
+
+    auto lock = lockMetered();
+    if(pending_->data.size() + inflight_bytes_ + size > options_.spill_bytes){
+        dropped_.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    // 空缓冲时后台线程可能在无限期等待, 需要唤醒它开始计时
+    bool wakeup = pending_->done();
+    pending_->data.append(prefix, prefix_len);
+    pending_->data.append(text);
+    pending_->sizes.push_back(static_cast<uint32_t>(size));
+    metrics_.add(LogMetrics::kBytes, size);
+    if(event.getLevel() >= LogLevel::Level::error && !urgent_){
+        urgent_ = true;
+        wakeup = true;
+    }
+    if(pending_->data.size() >= options_.batch_bytes && pending_->data.size() - size < options_.batch_bytes){
+        wakeup = true;
+    }
+    lock.unlock();
+    if(wakeup){
+        cv_.notify_one();
+    }
+}
+
+void SocketLogAppender::appendSyslogHeader(LogBuffer& buffer, const LogEvent& event)
+{
+    // 同一秒内复用已渲染的日期时间部分
+    thread_local time_t t_second = -1;
+    thread_local char t_datetime[32];
+    auto since = event.getTime().time_since_epoch();
+    time_t second = std::chrono::duration_cast<std::chrono::seconds>(since).count();
+    if(second != t_second){
+        struct tm tm;
+        gmtime_r(&second, &tm);
+        strftime(t_datetime, sizeof(t_datetime), "%Y-%m-%dT%H:%M:%S", &tm);
+        t_second = second;
+    }
+    auto micros = std::chrono::duration_cast<std::chrono::microseconds>(since).count() % 1000000;
+
+    char head[16];
+    int pri = options_.facility * 8 + SyslogSeverity(event.getLevel());
+    buffer.push_back('<');
+    buffer.append(head, std::to_chars(head, head + sizeof(head), pri).ptr - head);
+    buffer.append(">1 ");
+    buffer.append(t_datetime);
+    char frac[8] = {'.', '0', '0', '0', '0', '0', '0', 'Z'};
+    for(int i=6; i>0 && micros > 0; --i, micros /= 10){
+        frac[i] = static_cast<char>('0' + micros % 10);
+    }
+    buffer.append(frac, sizeof(frac));
+    buffer.push_back(' ');
+    buffer.append(hostname_);
+    buffer.push_back(' ');
+    buffer.append(app_name_);
+    buffer.push_back(' ');
+    buffer.append(procid_);
+    buffer.push_back(' ');
+    // MSGID 为日志器名称
+    std::string_view name = event.getLogger() ? std::string_view(event.getLogger()->getName()) : "";
+    if(name.empty()){
+        buffer.push_back('-');
+    }
+    for(char c : name.substr(0, 32)){
+        buffer.push_back(c > ' ' && c < 127 ? c : '_');
+    }
+    buffer.append(" - ");
+}
+
+void SocketLogAppender::flush()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    uint64_t seq = ++flush_seq_;
+    cv_.notify_one();
+    flushed_cv_.wait(lock, [&]{ return flushed_seq_ >= seq || !running_; });
+}
+
+size_t SocketLogAppender::getPendingBytes() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return pending_->data.size() + inflight_bytes_;
+}
+
+void SocketLogAppender::collectMetrics(LogMetrics::AppenderStats& stats) const
+{
+    LogAppender::collectMetrics(stats);
+    std::lock_guard<std::mutex> lock(mutex_);
+    stats.queue_depth = pending_->sizes.size() + inflight_records_;
+    stats.dropped = dropped_.load(std::memory_order_relaxed);
+}
+
+void SocketLogAppender::run()
+{
+    std::unique_lock<std::mutex> lock(mutex_);
+    for(;;){
+        auto now = std::chrono::steady_clock::now();
+        bool stopping = !running_;
+        bool has_data = !sending_->done() || !pending_->done();
+        bool ready = now >= retry_at_;
+        bool due = stopping || flush_seq_ != flushed_seq_
+            || (ready && has_data && (!sending_->done() || urgent_
+                || pending_->data.size() >= options_.batch_bytes || now - last_send_ >= options_.interval));
+        if(!due){
+            if(!has_data){
+                cv_.wait(lock);
+            }
+            else{
+                cv_.wait_until(lock, ready ? last_send_ + options_.interval : retry_at_);
+            }
+            continue;
+        }
+
+        uint64_t seq = flush_seq_;
+        bool swapped = sending_->done();
+        if(swapped){
+            sending_->clear();
+            std::swap(sending_, pending_);
+            urgent_ = false;
+        }
+        inflight_bytes_ = sending_->remaining();
+        inflight_records_ = sending_->sizes.size() - sending_->index;
+        lock.unlock();
+
+        uint64_t begin = LogMetrics::Now();
+        bool sent = sendBatch(stopping);
+        metrics_.add(LogMetrics::kWriteNs, LogMetrics::Now() - begin);
+
+        lock.lock();
+        inflight_bytes_ = sending_->remaining();
+        inflight_records_ = sending_->sizes.size() - sending_->index;
+        last_send_ = now;
+        // 本轮覆盖了 flush 之前的全部记录, 或对端不可用, flush 才算完成
+        if(swapped || !sent){
+            flushed_seq_ = std::max(flushed_seq_, seq);
+            flushed_cv_.notify_all();
+        }
+        // 停止时尽量发完, 对端不可用则放弃剩余记录
+        if(stopping && (!sent || pending_->done())){
+            break;
+        }
+    }
+}
+
+bool SocketLogAppender::sendBatch(bool force)
+{
+    Batch& batch = *sending_;
+    if(batch.done()){
+        return true;
+    }
+    int fd = fd_.load(std::memory_order_relaxed);
+    if(fd < 0){
+        if(!force && std::chrono::steady_clock::now() < retry_at_){
+            return false;
+        }
+        if(!connect()){
+            backoff();
+            return false;
+        }
+        backoff_ = options_.reconnect_min;
+        fd = fd_.load(std::memory_order_relaxed);
+    }
+
+    while(!batch.done()){
+        ssize_t n;
+        if(options_.protocol == Protocol::tcp){
+            // 记录连续存放, 一次写出整批
+            iovec iov{batch.data.data() + batch.offset + batch.partial, batch.remaining() - batch.partial};
+            msghdr msg{};
+            msg.msg_iov = &iov;
+            msg.msg_iovlen = 1;
+            n = ::sendmsg(fd, &msg, MSG_NOSIGNAL);
+            if(n > 0){
+                size_t sent = batch.partial + static_cast<size_t>(n);
+                while(!batch.done() && sent >= batch.sizes[batch.index]){
+                    sent -= batch.sizes[batch.index];
+                    batch.offset += batch.sizes[batch.index++];
+                }
+                batch.partial = sent;
+            }
+        }
+        else{
+            mmsghdr msgs[kMaxMessages];
+            iovec iovs[kMaxMessages];
+            unsigned int count = 0;
+            size_t offset = batch.offset;
+            for(size_t i=batch.index; i<batch.sizes.size() && count<kMaxMessages; ++i, ++count){
+                iovs[count] = iovec{batch.data.data() + offset, batch.sizes[i]};
+                msgs[count] = mmsghdr{};
+                msgs[count].msg_hdr.msg_iov = &iovs[count];
+                msgs[count].msg_hdr.msg_iovlen = 1;
+                offset += batch.sizes[i];
+            }
+            n = ::sendmmsg(fd, msgs, count, MSG_NOSIGNAL);
+            for(ssize_t i=0; i<n; ++i){
+                batch.offset += batch.sizes[batch.index++];
+            }
+            if(n < 0 && errno == EMSGSIZE){
+                // 超过数据报上限的记录无法发出, 丢弃后继续
+                batch.offset += batch.sizes[batch.index++];
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                continue;
+            }
+        }
+        if(n < 0 && errno == EINTR){
+            continue;
+        }
+        if(n == 0 || (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS))){
+            // 对端接收慢, 稍后重试
+            retry_at_ = std::chrono::steady_clock::now() + kRetryDelay;
+            return false;
+        }
+        if(n < 0){
+            // 连接断开, 未写完的记录在重连后整条重发
+            disconnect();
+            batch.partial = 0;
+            backoff();
+            return false;
+        }
+    }
+    batch.clear();
+    return true;
+}
+
+void SocketLogAppender::backoff()
+{
+    retry_at_ = std::chrono::steady_clock::now() + backoff_;
+    backoff_ = std::min(backoff_ * 2, options_.reconnect_max);
+}
+
+bool SocketLogAppender::connect()
+{
+    int fd = -1;
+    if(options_.protocol == Protocol::unix_dgram){
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        if(options_.address.size() >= sizeof(addr.sun_path)){
+            return false;
+        }
+        std::memcpy(addr.sun_path, options_.address.data(), options_.address.size());
+        fd = ::socket(AF_UNIX, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+        if(fd < 0){
+            return false;
+        }
+        if(::connect(fd, reinterpret_cast<sockaddr*>(&addr), sizeof(addr)) != 0){
+            ::close(fd);
+            return false;
+        }
+    }
+    else{
+        bool tcp = options_.protocol == Protocol::tcp;
+        addrinfo hints{};
+        hints.ai_family = AF_UNSPEC;
+        hints.ai_socktype = tcp ? SOCK_STREAM : SOCK_DGRAM;
+        addrinfo* result = nullptr;
+        if(::getaddrinfo(options_.address.c_str(), std::to_string(options_.port).c_str(), &hints, &result) != 0){
+            return false;
+        }
+        for(addrinfo* ai = result; ai; ai = ai->ai_next){
+            fd = ::socket(ai->ai_family, ai->ai_socktype | SOCK_CLOEXEC | SOCK_NONBLOCK, ai->ai_protocol);
+            if(fd < 0){
+                continue;
+            }
+            if(ConnectTimeout(fd, ai->ai_addr, ai->ai_addrlen, options_.connect_timeout)){
+                break;
+            }
+            ::close(fd);
+            fd = -1;
+        }
+        ::freeaddrinfo(result);
+        if(fd < 0){
+            return false;
+        }
+        ::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+    }
+    // 发送缓冲满时最多阻塞 100ms, 停止时不会卡住后台线程
+    timeval timeout{0, 100 * 1000};
+    ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+    fd_.store(fd, std::memory_order_release);
+    return true;
+}
+
+void SocketLogAppender::disconnect()
+{
+    int fd = fd_.exchange(-1, std::memory_order_acq_rel);
+    if(fd >= 0){
+        ::close(fd);
+    }
+}
+
+void SocketLogAppender::drain()
+{
+    // 不加锁: 崩溃的线程可能正持有 mutex_
+    int fd = fd_.load(std::memory_order_acquire);
+    if(fd < 0){
+        return;
+    }
+    drainBatch(fd, *sending_);
+    drainBatch(fd, *pending_);
+}
+
+void SocketLogAppender::drainBatch(int fd, const Batch& batch)
+{
+    size_t offset = batch.offset;
+    size_t partial = batch.partial;
+    for(size_t i=batch.index; i<batch.sizes.size(); ++i){
+        const char* p = batch.data.data() + offset + partial;
+        size_t left = batch.sizes[i] - partial;
+        offset += batch.sizes[i];
+        partial = 0;
+        while(left > 0){
+            ssize_t n = ::send(fd, p, left, MSG_DONTWAIT | MSG_NOSIGNAL);
+            if(n < 0){
+                if(errno == EINTR){
+                    continue;
+                }
+                return;
+            }
+            if(options_.protocol != Protocol::tcp){
+                break;
+            }
+            p += n;
+            left -= static_cast<size_t>(n);
+        }
+    }
+}
+
+} // namespace log4cpp
@@ -1,13 +1,72 @@
 #include "log.hpp"
+#include "async.hpp"
+#include "rolling.hpp"
+#include "mmap.hpp"
+#include "binary.hpp"
+#include "crash.hpp"
+#include "config.hpp"
+#include "socket.hpp"
+#include <atomic>
 #include <thread>
 #include <vector>
 #include <chrono>
 #include <iostream>
 #include <future>
 #include <execution>
+#include <cstdlib>
+#include <algorithm>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <new>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 
 using namespace log4cpp;
 
+// 统计当前线程的堆分配次数
+static thread_local bool t_count_allocs = false;
+static thread_local uint64_t t_allocs = 0;
+
+// 替换全局 operator new/delete 时 GCC 会把内联后的 free 误判为与 new 不配对
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wmismatched-new-delete"
+void* operator new(std::size_t size){
+    if(t_count_allocs){
+        ++t_allocs;
+    }
+    if(void* p = std::malloc(size ? size : 1)){
+        return p;
+    }
+    throw std::bad_alloc();
+}
+void* operator new[](std::size_t size){
+    return operator new(size);
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete[](void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+void operator delete[](void* p, std::size_t) noexcept { std::free(p); }
+#pragma GCC diagnostic pop
+
+// 统计进程创建的线程数
+static std::atomic<uint64_t> g_threads_created{0};
+
+extern "C" int pthread_create(pthread_t* thread, const pthread_attr_t* attr, void* (*start)(void*), void* arg) noexcept {
+    using Create = int (*)(pthread_t*, const pthread_attr_t*, void* (*)(void*), void*);
+    static Create real = reinterpret_cast<Create>(::dlsym(RTLD_NEXT, "pthread_create"));
+    g_threads_created.fetch_add(1, std::memory_order_relaxed);
+    return real(thread, attr, start, arg);
+}
+
 
 void thread_func(Logger::ptr logger){
     LOG_INFO(logger) << "Thread id: " << std::this_thread::get_id();
@@ -46,7 +105,1222 @@ void log_test_parallel(){
     std::for_each(std::execution::par, loggers.begin(), loggers.end(), thread_func);
 }
 
+// 只计数不输出的输出器
+class CountLogAppender : public LogAppender{
+public:
+    using ptr = std::shared_ptr<CountLogAppender>;
+    void log(LogEvent::ptr /*event*/) override {
+        if(delay_.count()){
+            std::this_thread::sleep_for(delay_);
+        }
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    void setDelay(std::chrono::microseconds delay) { delay_ = delay; }
+    uint64_t getCount() const { return count_.load(); }
+private:
+    std::chrono::microseconds delay_{0};
+    std::atomic<uint64_t> count_{0};
+};
+
+bool log_test_async(){
+    bool ok = true;
+    const int threads_num = 8, per_thread = 2000;
+    using Policy = AsyncLogAppender::OverflowPolicy;
+    for(auto policy : {Policy::block, Policy::drop_newest, Policy::drop_oldest}){
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "async");
+        auto counter = std::make_shared<CountLogAppender>();
+        if(policy != Policy::block){
+            counter->setDelay(std::chrono::microseconds(1));
+        }
+        AsyncLogAppender::Options options;
+        options.capacity = 64;
+        options.queues = 2;
+        options.workers = 2;
+        options.policy = policy;
+        auto async = std::make_shared<AsyncLogAppender>(counter, options);
+        logger->addAppender(async);
+
+        std::vector<std::jthread> threads;
+        for(int i=0; i<threads_num; ++i){
+            threads.emplace_back([logger]{
+                for(int j=0; j<per_thread; ++j){
+                    LOG_INFO(logger) << "async " << j;
+                }
+            });
+        }
+        threads.clear();
+        async->flush();
+
+        uint64_t total = counter->getCount() + async->getDropped();
+        if(total != uint64_t(threads_num) * per_thread
+                || (policy == Policy::block && async->getDropped() != 0)){
+            std::cerr << "log_test_async failed: policy=" << int(policy)
+                      << " written=" << counter->getCount()
+                      << " dropped=" << async->getDropped() << std::endl;
+            ok = false;
+        }
+    }
+    return ok;
+}
+
+// 丢弃输出, 但完整执行格式化
+class NullLogAppender : public LogAppender{
+public:
+    void log(LogEvent::ptr event) override {
+        mutex_.lock();
+        formatter_->format(os_, event);
+        mutex_.unlock();
+    }
+private:
+    class NullBuf : public std::streambuf{
+    protected:
+        int overflow(int c) override { return c; }
+        std::streamsize xsputn(const char*, std::streamsize n) override { return n; }
+    };
+    NullBuf buf_;
+    std::ostream os_{&buf_};
+};
+
+// 记录最后一条消息内容
+class CaptureLogAppender : public LogAppender{
+public:
+    using ptr = std::shared_ptr<CaptureLogAppender>;
+    void log(LogEvent::ptr event) override {
+        mutex_.lock();
+        last_ = event->getContentView();
+        mutex_.unlock();
+    }
+    std::string getLast() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_;
+    }
+private:
+    std::string last_;
+};
+
+bool log_test_snapshot(){
+    // 记录日志的同时反复增删输出器, 常驻输出器不丢事件
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "snapshot");
+    auto counter = std::make_shared<CountLogAppender>();
+    logger->addAppender(counter);
+    const int threads_num = 4, per_thread = 5000;
+    std::atomic<bool> done{false};
+    std::thread mutator([&]{
+        auto extra = std::make_shared<CountLogAppender>();
+        while(!done.load()){
+            logger->addAppender(extra);
+            logger->delAppender(extra);
+            logger->hasStdoutAppender();
+        }
+    });
+    std::vector<std::thread> threads;
+    for(int t=0; t<threads_num; ++t){
+        threads.emplace_back([&logger]{
+            for(int i=0; i<per_thread; ++i){
+                LOG_INFO(logger) << "snapshot " << i;
+            }
+        });
+    }
+    for(auto& th : threads){
+        th.join();
+    }
+    done = true;
+    mutator.join();
+    if(counter->getCount() != uint64_t(threads_num) * per_thread){
+        std::cerr << "log_test_snapshot failed: " << counter->getCount() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool log_test_registry(){
+    // 并发注册/查找同一批名称, 每个名称只对应一个日志器
+    const int threads_num = 8, names = 64;
+    std::vector<std::vector<Logger*>> seen(threads_num, std::vector<Logger*>(names));
+    std::vector<std::thread> threads;
+    for(int t=0; t<threads_num; ++t){
+        threads.emplace_back([&seen, t]{
+            for(int i=0; i<names; ++i){
+                int n = (i + t * 7) % names;
+                seen[t][n] = LoggerManager::getInstance().getLogger("registry." + std::to_string(n)).get();
+            }
+        });
+    }
+    for(auto& th : threads){
+        th.join();
+    }
+    bool ok = true;
+    for(int t=1; t<threads_num; ++t){
+        ok = ok && seen[t] == seen[0];
+    }
+
+    auto lookup = []{ return LOG4CPP_LOGGER("registry.7"); };
+    ok = ok && lookup() == seen[0][7] && lookup() == lookup();
+    LOG_DEBUG(LOG4CPP_LOGGER("registry.cached")) << "cached handle";
+    if(!ok){
+        std::cerr << "log_test_registry failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_hierarchy(){
+    auto& lm = LoggerManager::getInstance();
+    auto leaf = lm.getLogger("hier.a.b");
+    auto mid = lm.getLogger("hier.a");
+    auto top = lm.getLogger("hier");
+    bool ok = leaf->getParent() == mid.get() && mid->getParent() == top.get()
+            && top->getParent() == lm.getRoot().get();
+
+    auto top_counter = std::make_shared<CountLogAppender>();
+    auto leaf_counter = std::make_shared<CountLogAppender>();
+    top->addAppender(top_counter);
+    leaf->addAppender(leaf_counter);
+    // 同一输出器挂在祖先和自身上只输出一次
+    leaf->addAppender(top_counter);
+
+    LOG_INFO(leaf) << "both";
+    ok = ok && top_counter->getCount() == 1 && leaf_counter->getCount() == 1;
+
+    // 祖先的级别变化传播到未显式设置级别的后代
+    top->setLevel(LogLevel::Level::warn);
+    LOG_INFO(leaf) << "filtered";
+    ok = ok && !leaf->hasLevel() && leaf->getLevel() == LogLevel::Level::warn;
+    mid->setLevel(LogLevel::Level::debug);
+    LOG_DEBUG(leaf) << "mid level";
+    ok = ok && top_counter->getCount() == 2 && leaf_counter->getCount() == 2;
+    mid->unsetLevel();
+    ok = ok && leaf->getLevel() == LogLevel::Level::warn;
+    top->setLevel(LogLevel::Level::debug);
+
+    leaf->delAppender(top_counter);
+    leaf->setAdditivity(false);
+    LOG_INFO(leaf) << "own only";
+    ok = ok && top_counter->getCount() == 2 && leaf_counter->getCount() == 3;
+    leaf->setAdditivity(true);
+    LOG_INFO(mid) << "inherited";
+    ok = ok && top_counter->getCount() == 3 && leaf_counter->getCount() == 3;
+
+    top->clearAppender();
+    leaf->clearAppender();
+    if(!ok){
+        std::cerr << "log_test_hierarchy failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_stdout(){
+    // 把标准输出临时接到管道上, 非终端时攒批写出
+    int fds[2];
+    if(::pipe(fds) != 0){
+        return false;
+    }
+    std::cout.flush();
+    int saved = ::dup(STDOUT_FILENO);
+    ::dup2(fds[1], STDOUT_FILENO);
+
+    bool ok = true;
+    {
+        StdoutLogAppender::Options options;
+        options.color = true;
+        options.interval = std::chrono::milliseconds(-1);
+        auto appender = std::make_shared<StdoutLogAppender>(options);
+        appender->setFormatter(std::make_shared<LogFormatter>("%p %m%n"));
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "stdout");
+        logger->addAppender(appender);
+        ok = ok && !appender->isTty();
+        LOG_INFO(logger) << "first";
+        LOG_DEBUG(logger) << "second";
+        logger->clearAppender();
+    }
+    ::dup2(saved, STDOUT_FILENO);
+    ::close(saved);
+    ::close(fds[1]);
+
+    std::string out;
+    char buf[4096];
+    ssize_t n;
+    while((n = ::read(fds[0], buf, sizeof(buf))) > 0){
+        out.append(buf, n);
+    }
+    ::close(fds[0]);
+    ok = ok && out == "\x1b[32minfo first\x1b[0m\n\x1b[36mdebug second\x1b[0m\n";
+
+    // 只写一行且之后不再记录日志, 定时器在 interval 后写出
+    if(::pipe(fds) != 0){
+        return false;
+    }
+    std::cout.flush();
+    saved = ::dup(STDOUT_FILENO);
+    ::dup2(fds[1], STDOUT_FILENO);
+    {
+        StdoutLogAppender::Options options;
+        options.interval = std::chrono::milliseconds(100);
+        auto appender = std::make_shared<StdoutLogAppender>(options);
+        appender->setFormatter(std::make_shared<LogFormatter>("%p %m%n"));
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "stdout");
+        logger->addAppender(appender);
+        auto begin = std::chrono::steady_clock::now();
+        LOG_INFO(logger) << "quiet";
+        pollfd pfd{fds[0], POLLIN, 0};
+        bool buffered = ::poll(&pfd, 1, 0) == 0;
+        bool arrived = ::poll(&pfd, 1, 2000) == 1;
+        auto waited = std::chrono::steady_clock::now() - begin;
+        n = arrived ? ::read(fds[0], buf, sizeof(buf)) : 0;
+        out.assign(buf, n > 0 ? n : 0);
+        ok = ok && buffered && arrived && out == "info quiet\n" && waited < std::chrono::milliseconds(500);
+        logger->clearAppender();
+    }
+    ::dup2(saved, STDOUT_FILENO);
+    ::close(saved);
+    ::close(fds[1]);
+    ::close(fds[0]);
+    if(!ok){
+        std::cerr << "log_test_stdout failed: " << out << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_metrics(){
+    namespace fs = std::filesystem;
+    std::string path = (fs::temp_directory_path() / ("log4cpp_metrics_" + std::to_string(::getpid()) + ".log")).string();
+    auto& lm = LoggerManager::getInstance();
+    auto logger = lm.getLogger("metrics.test");
+    auto appender = std::make_shared<FileLogAppender>(path);
+    logger->addAppender(appender);
+    logger->setLevel(LogLevel::Level::info);
+    for(int i=0; i<10; ++i){
+        LOG_INFO(logger) << "metrics " << i;
+        LOG_DEBUG(logger) << "filtered " << i;
+    }
+    appender->flush();
+
+    bool ok = true;
+    LogMetrics metrics = lm.getMetrics();
+    auto lit = std::find_if(metrics.loggers.begin(), metrics.loggers.end(),
+            [](const LogMetrics::LoggerStats& s){ return s.name == "metrics.test"; });
+    ok = ok && lit != metrics.loggers.end() && lit->emitted[2] == 10 && lit->filtered == 10;
+    auto ait = std::find_if(metrics.appenders.begin(), metrics.appenders.end(),
+            [&path](const LogMetrics::AppenderStats& s){ return s.name == "file:" + path; });
+    ok = ok && ait != metrics.appenders.end() && ait->events == 10
+            && ait->bytes == fs::file_size(path) && ait->format_ns > 0;
+
+    // 周期性自检报告
+    auto target = std::make_shared<Logger>(LogLevel::Level::debug, "metrics.report");
+    auto capture = std::make_shared<CaptureLogAppender>();
+    target->addAppender(capture);
+    lm.startMetricsReport(target, std::chrono::milliseconds(5));
+    for(int i=0; i<200 && capture->getLast().empty(); ++i){
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+    lm.stopMetricsReport();
+    ok = ok && capture->getLast().rfind("metrics ", 0) == 0;
+
+    logger->clearAppender();
+    appender.reset();
+    fs::remove(path);
+    if(!ok){
+        std::cerr << "log_test_metrics failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_limited(){
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "limited");
+    auto counter = std::make_shared<CountLogAppender>();
+    auto capture = std::make_shared<CaptureLogAppender>();
+    logger->addAppender(counter);
+    logger->addAppender(capture);
+    bool ok = true;
+
+    for(int i=0; i<100; ++i){
+        LOG_EVERY_N(logger, "info", 10) << "every n " << i;
+    }
+    ok = ok && counter->getCount() == 10 && capture->getLast() == "every n 90";
+
+    for(int i=0; i<100; ++i){
+        LOG_FIRST_N(logger, "info", 5) << "first n " << i;
+    }
+    ok = ok && counter->getCount() == 15 && capture->getLast() == "first n 4";
+
+    auto every_t = [&](int i){ LOG_EVERY_T(logger, "info", 0.05) << "every t " << i; };
+    for(int i=0; i<1000; ++i){
+        every_t(i);
+    }
+    ok = ok && counter->getCount() == 16;
+    std::this_thread::sleep_for(std::chrono::milliseconds(60));
+    // 窗口结束本身不输出汇总
+    ok = ok && counter->getCount() == 16 && capture->getLast() == "every t 0";
+    // 新窗口的第一条之前补一条汇总
+    every_t(1000);
+    ok = ok && counter->getCount() == 18 && capture->getLast() == "every t 1000";
+
+    uint64_t before = counter->getCount();
+    auto limited = [&](int i){ LOG_RATE_LIMITED(logger, "error", 10) << "limited " << i; };
+    for(int i=0; i<1000; ++i){
+        limited(i);
+    }
+    uint64_t burst = counter->getCount() - before;
+    ok = ok && burst >= 10 && burst <= 12;
+    std::this_thread::sleep_for(std::chrono::milliseconds(250));
+    ok = ok && counter->getCount() == before + burst;
+    before = counter->getCount();
+    limited(1000);
+    ok = ok && counter->getCount() == before + 2 && capture->getLast() == "limited 1000";
+
+    // 被级别过滤时不消耗限流状态
+    logger->setLevel(LogLevel::Level::error);
+    for(int i=0; i<10; ++i){
+        LOG_FIRST_N(logger, "info", 1) << "filtered";
+    }
+    ok = ok && capture->getLast() == "limited 1000";
+    if(!ok){
+        std::cerr << "log_test_limited failed: " << counter->getCount() << " " << capture->getLast() << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_format(){
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "format");
+    auto capture = std::make_shared<CaptureLogAppender>();
+    logger->addAppender(capture);
+    bool ok = true;
+    auto expect = [&](const std::string& expected){
+        if(capture->getLast() != expected){
+            std::cerr << "log_test_format failed: \"" << capture->getLast()
+                      << "\" != \"" << expected << "\"" << std::endl;
+            ok = false;
+        }
+    };
+    std::string name = "query";
+    LOG4CPP_INFO(logger, "{} took {}us", name, 42);
+    expect("query took 42us");
+    LOG4CPP_WARN(logger, "{{literal}} {} {}", 1.5, 'c');
+    expect("{literal} 1.5 c");
+    LOG4CPP_ERROR(logger, "no args");
+    expect("no args");
+    LOG_FMT(logger, "info", "%s=%d", "printf", 7);
+    expect("printf=7");
+    return ok;
+}
+
+// 记录最后一条格式化后的输出
+class FormatCaptureAppender : public LogAppender{
+public:
+    using ptr = std::shared_ptr<FormatCaptureAppender>;
+    void log(LogEvent::ptr event) override {
+        mutex_.lock();
+        last_ = formatter_->format(event);
+        mutex_.unlock();
+    }
+    std::string getLast() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return last_;
+    }
+private:
+    std::string last_;
+};
+
+bool log_test_formatter(){
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "pattern");
+    auto dynamic = std::make_shared<FormatCaptureAppender>();
+    auto compiled = std::make_shared<FormatCaptureAppender>();
+    dynamic->setFormatter(std::make_shared<LogFormatter>("[%p]%T%c%T%%%F%T%m%n"));
+    compiled->setFormatter(std::make_shared<StaticLogFormatter<"[%p]%T%c%T%%%F%T%m%n">>());
+    logger->addAppender(dynamic);
+    logger->addAppender(compiled);
+    LOG_WARN(logger) << "hello " << 42;
+    std::string expected = "[warn]\tpattern\t%0\thello 42\n";
+    if(dynamic->getLast() != expected || compiled->getLast() != expected){
+        std::cerr << "log_test_formatter failed: \"" << dynamic->getLast() << "\" \""
+                  << compiled->getLast() << "\"" << std::endl;
+        return false;
+    }
+    if(!LogFormatter("%d{%Y").isError() || !LogFormatter("%x").isError()){
+        std::cerr << "log_test_formatter failed: invalid pattern accepted" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool log_test_datetime(){
+    using namespace std::chrono;
+    static constexpr LogSite site{LogLevel::Level::info, __FILE__, __LINE__, __func__};
+    Logger logger(LogLevel::Level::debug, "time");
+    // 2021-03-04T05:06:07.089123456Z
+    log4cpp::time_point tp{duration_cast<system_clock::duration>(nanoseconds(1614834367089123456LL))};
+    LogFormatter iso("%d{ISO8601}");
+    LogFormatter utc("%d{UTC:%Y-%m-%d %H:%M:%S.%ms|%us|%ns}");
+    bool ok = true;
+    auto check = [&](LogFormatter& formatter, log4cpp::time_point t, const std::string& expected){
+        LogEvent event(&logger, &site, 0, 1, 0, t, "main");
+        LogBuffer buffer;
+        formatter.format(buffer, event);
+        if(buffer.view() != expected){
+            std::cerr << "log_test_datetime failed: \"" << buffer.view() << "\" != \"" << expected << "\"" << std::endl;
+            ok = false;
+        }
+    };
+    check(iso, tp, "2021-03-04T05:06:07.089Z");
+    check(utc, tp, "2021-03-04 05:06:07.089|089123|089123456");
+    // 同一秒内命中缓存, 只修补亚秒
+    check(utc, tp + milliseconds(500), "2021-03-04 05:06:07.589|589123|589123456");
+    check(utc, tp + seconds(1), "2021-03-04 05:06:08.089|089123|089123456");
+    // 超出缓存的长格式与短格式结果一致
+    std::string pad(80, '-');
+    LogFormatter long_utc("%d{UTC:" + pad + "%Y-%m-%d %H:%M:%S.%ms}");
+    check(long_utc, tp, pad + "2021-03-04 05:06:07.089");
+    return ok;
+}
+
+static thread_local uint32_t t_fiber_id = 0;
+
+bool log_test_thread(){
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "thread");
+    auto appender = std::make_shared<FormatCaptureAppender>();
+    appender->setFormatter(std::make_shared<LogFormatter>("%t|%N|%F|%m"));
+    logger->addAppender(appender);
+    std::string expected;
+    std::thread([&]{
+        setThreadName("log4cpp-worker-thread");
+        setFiberIdProvider([]{ return t_fiber_id; });
+        t_fiber_id = 7;
+        LOG_INFO(logger) << "a";
+        expected = std::to_string(::gettid()) + "|log4cpp-worker-|7|a";
+        setFiberIdProvider(nullptr);
+    }).join();
+    if(appender->getLast() != expected){
+        std::cerr << "log_test_thread failed: \"" << appender->getLast() << "\" != \"" << expected << "\"" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool log_test_clock(){
+    using namespace std::chrono;
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "clock");
+    auto appender = std::make_shared<FormatCaptureAppender>();
+    appender->setFormatter(std::make_shared<LogFormatter>("%r"));
+    logger->addAppender(appender);
+    bool ok = true;
+    for(auto source : {LogClock::Source::system, LogClock::Source::coarse, LogClock::Source::tsc}){
+        if(!LogClock::SetSource(source)){
+            continue;
+        }
+        // 换算出的墙钟时间与 system_clock 的差距应在一个时钟节拍之内
+        auto now = system_clock::now();
+        auto diff = LogClock::ToTimePoint(LogClock::Now()) - now;
+        LOG_INFO(logger) << "a";
+        uint32_t before = std::stoul(appender->getLast());
+        std::this_thread::sleep_for(milliseconds(30));
+        LOG_INFO(logger) << "b";
+        uint32_t after = std::stoul(appender->getLast());
+        if(diff < milliseconds(-20) || diff > milliseconds(20) || after < before + 25 || after > before + 1000){
+            std::cerr << "log_test_clock failed: source " << static_cast<int>(source)
+                      << " diff " << duration_cast<microseconds>(diff).count()
+                      << "us elapse " << before << " -> " << after << std::endl;
+            ok = false;
+        }
+    }
+    LogClock::SetSource(LogClock::Source::system);
+    return ok;
+}
+
+bool log_test_json(){
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "json");
+    auto appender = std::make_shared<FormatCaptureAppender>();
+    appender->setFormatter(std::make_shared<JsonLogFormatter>());
+    logger->addAppender(appender);
+    bool ok = true;
+    auto check = [&](const std::string& expected){
+        if(appender->getLast().find(expected) == std::string::npos){
+            std::cerr << "log_test_json failed: \"" << appender->getLast() << "\" lacks \"" << expected << "\"" << std::endl;
+            ok = false;
+        }
+    };
+    LOG_INFO(logger).kv("user", 42).kv("ms", 1.5).kv("ok", true).kv("name", std::string("bob\t")) << "done";
+    check("\"level\":\"info\",\"logger\":\"json\",");
+    check("\"message\":\"done\",\"fields\":{\"user\":42,\"ms\":1.5,\"ok\":true,\"name\":\"bob\\t\"}}\n");
+    LOG_INFO(logger) << "plain";
+    check("\"message\":\"plain\"}\n");
+
+    // 长消息走向量化扫描, 与逐字节转义的结果比较
+    std::string message;
+    for(int i=0; i<200; ++i){
+        message += static_cast<char>(i % 7 == 0 ? '"' : i % 11 == 0 ? '\\' : i % 13 == 0 ? 1 : 'a' + i % 26);
+    }
+    std::string expected;
+    for(char c : message){
+        if(c == '"' || c == '\\'){
+            expected += '\\';
+            expected += c;
+        }
+        else if(c == 1){
+            expected += "\\u0001";
+        }
+        else{
+            expected += c;
+        }
+    }
+    LOG_INFO(logger) << message;
+    check("\"message\":\"" + expected + "\"}");
+    return ok;
+}
+
+static std::string read_file(const std::string& path){
+    std::ifstream ifs(path);
+    std::stringstream ss;
+    ss << ifs.rdbuf();
+    return ss.str();
+}
+
+static size_t count_lines(const std::string& str){
+    return std::count(str.begin(), str.end(), '\n');
+}
+
+bool log_test_file(){
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("log4cpp_file_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string path = (dir / "app.log").string();
+
+    bool ok = true;
+    auto expect = [&](const std::string& file, size_t lines, const char* what){
+        size_t n = count_lines(read_file(file));
+        if(n != lines){
+            std::cerr << "log_test_file failed: " << what << " lines=" << n << " expected=" << lines << std::endl;
+            ok = false;
+        }
+    };
+    {
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "file");
+        FileLogAppender::FlushPolicy policy;
+        policy.interval = std::chrono::milliseconds(-1);
+        auto appender = std::make_shared<FileLogAppender>(path, policy);
+        logger->addAppender(appender);
+
+        LOG_INFO(logger) << "buffered";
+        expect(path, 0, "buffered");
+        LOG_ERROR(logger) << "error flushes";
+        expect(path, 2, "error level");
+
+        // 文件被移走后显式 reopen 写到新文件
+        fs::rename(path, path + ".1");
+        LOG_INFO(logger) << "after rename";
+        appender->reopen();
+        LOG_INFO(logger) << "reopened";
+        appender->flush();
+        expect(path + ".1", 3, "rotated");
+        expect(path, 1, "reopened");
+    }
+    {
+        // 空闲时缓冲由后台定时器在 interval 后写出
+        std::string quiet = (dir / "quiet.log").string();
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "file");
+        FileLogAppender::FlushPolicy policy;
+        policy.interval = std::chrono::milliseconds(100);
+        logger->addAppender(std::make_shared<FileLogAppender>(quiet, policy));
+        LOG_INFO(logger) << "quiet";
+        expect(quiet, 0, "before interval");
+        for(int i=0; i<100 && count_lines(read_file(quiet)) == 0; ++i){
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        expect(quiet, 1, "after interval");
+    }
+    fs::remove_all(dir);
+    return ok;
+}
+
+// 接收格式化好的文本, 写出时不加锁; 可以从外部持有 mutex_
+class UnlockedTextAppender : public LogAppender{
+public:
+    void log(LogEvent::ptr /*event*/) override {}
+    bool acceptsFormatted() const override { return true; }
+    void logFormatted(const LogEvent& /*event*/, std::string_view /*text*/) override {
+        count_.fetch_add(1, std::memory_order_relaxed);
+    }
+    std::unique_lock<std::mutex> hold() { return std::unique_lock<std::mutex>(mutex_); }
+    uint64_t getCount() const { return count_.load(std::memory_order_relaxed); }
+private:
+    std::atomic<uint64_t> count_{0};
+};
+
+bool log_test_fanout(){
+    // 共用格式化器的输出器只格式化一次, 自定义输出器仍收到事件
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("log4cpp_fanout_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string first = (dir / "first.log").string();
+    std::string second = (dir / "second.log").string();
+    std::string own = (dir / "own.log").string();
+
+    bool ok = true;
+    {
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "fanout");
+        auto a = std::make_shared<FileLogAppender>(first);
+        auto b = std::make_shared<FileLogAppender>(second);
+        auto c = std::make_shared<FileLogAppender>(own);
+        c->setFormatter(std::make_shared<LogFormatter>("%p %m%n"));
+        auto capture = std::make_shared<CaptureLogAppender>();
+        logger->addAppender(a);
+        logger->addAppender(b);
+        logger->addAppender(c);
+        logger->addAppender(capture);
+        for(int i=0; i<10; ++i){
+            LOG_INFO(logger) << "fanout " << i;
+        }
+        a->flush();
+        b->flush();
+        c->flush();
+
+        LogMetrics::AppenderStats sa, sb, sc;
+        a->collectMetrics(sa);
+        b->collectMetrics(sb);
+        c->collectMetrics(sc);
+        ok = ok && sa.format_ns > 0 && sb.format_ns == 0 && sc.format_ns > 0;
+        ok = ok && sa.events == 10 && sb.events == 10 && sb.bytes == fs::file_size(second);
+        ok = ok && count_lines(read_file(first)) == 10 && read_file(first) == read_file(second);
+        ok = ok && read_file(own).rfind("info fanout 0\n", 0) == 0;
+        ok = ok && capture->getLast() == "fanout 9";
+    }
+    {
+        // 分发时取格式化器不加输出器的锁
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "fanout");
+        auto unlocked = std::make_shared<UnlockedTextAppender>();
+        logger->addAppender(unlocked);
+        auto lock = unlocked->hold();
+        auto done = std::async(std::launch::async, [&logger]{ LOG_INFO(logger) << "unlocked"; });
+        ok = done.wait_for(std::chrono::seconds(2)) == std::future_status::ready && ok;
+        lock.unlock();
+        done.wait();
+        ok = ok && unlocked->getCount() == 1;
+    }
+    fs::remove_all(dir);
+    if(!ok){
+        std::cerr << "log_test_fanout failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_rolling(){
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("log4cpp_rolling_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string path = (dir / "app.log").string();
+
+    bool ok = true;
+    for(auto compression : {RollingFileAppender::Compression::none, RollingFileAppender::Compression::gzip}){
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "rolling");
+        RollingFileAppender::Options options;
+        options.max_bytes = 4096;
+        options.max_files = 3;
+        options.compression = compression;
+        // 名称不符合归档格式的同前缀文件不参与保留策略; 遗留的 .roll 文件在启动时补做归档
+        for(const char* other : {"app.log.bak", "app.log.lock", "app.log.1.err"}){
+            std::ofstream(dir / other) << "keep";
+        }
+        // 遗留的 .roll 文件只接管写入进程已退出的; 仍在运行的进程的文件不动
+        pid_t dead = ::fork();
+        if(dead == 0){
+            _exit(0);
+        }
+        ::waitpid(dead, nullptr, 0);
+        std::string stale = "app.log." + std::to_string(dead) + ".1.roll";
+        std::string live = "app.log." + std::to_string(::getppid()) + ".1.roll";
+        std::ofstream(dir / stale) << "staged";
+        std::ofstream(dir / live) << "live";
+        auto appender = std::make_shared<RollingFileAppender>(path, options);
+        logger->addAppender(appender);
+        for(int i=0; i<1000; ++i){
+            LOG_INFO(logger) << "rolling line " << i;
+        }
+        appender->flush();
+        appender->waitIdle();
+
+        size_t archives = 0;
+        for(auto& entry : fs::directory_iterator(dir)){
+            std::string name = entry.path().filename().string();
+            if(name == "app.log.bak" || name == "app.log.lock" || name == "app.log.1.err" || name == live){
+                continue;
+            }
+            if(name.size() > 5 && name.compare(name.size() - 5, 5, ".roll") == 0){
+                ok = false;
+            }
+            if(name == "app.log"){
+                if(entry.file_size() > options.max_bytes){
+                    ok = false;
+                }
+                continue;
+            }
+            ++archives;
+            if(entry.file_size() < options.max_bytes / 4 && compression == RollingFileAppender::Compression::none){
+                ok = false;
+            }
+        }
+        if(archives != options.max_files){
+            std::cerr << "log_test_rolling failed: archives=" << archives << std::endl;
+            ok = false;
+        }
+        for(const char* other : {"app.log.bak", "app.log.lock", "app.log.1.err"}){
+            ok = ok && read_file((dir / other).string()) == "keep";
+        }
+        ok = ok && read_file((dir / live).string()) == "live";
+        logger->clearAppender();
+        appender.reset();
+        fs::remove_all(dir);
+        fs::create_directories(dir);
+    }
+    fs::remove_all(dir);
+    if(!ok){
+        std::cerr << "log_test_rolling failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_mmap(){
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("log4cpp_mmap_" + std::to_string(::getpid()));
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    std::string base = (dir / "app.log").string();
+
+    bool ok = true;
+    {
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "mmap");
+        auto appender = std::make_shared<MmapFileAppender>(base, 4096);
+        logger->addAppender(appender);
+        std::vector<std::thread> threads;
+        for(int t=0; t<4; ++t){
+            threads.emplace_back([&logger, t]{
+                for(int i=0; i<500; ++i){
+                    LOG_INFO(logger) << "mmap thread " << t << " line " << i;
+                }
+            });
+        }
+        for(auto& th : threads){
+            th.join();
+        }
+        if(appender->getSegmentIndex() < 2){
+            ok = false;
+        }
+        logger->clearAppender();
+    }
+
+    // 封段后各段被截断到实际长度, 不应残留 '\0'
+    size_t lines = 0;
+    for(auto& entry : fs::directory_iterator(dir)){
+        std::string content = read_file(entry.path().string());
+        if(content.find('\0') != std::string::npos){
+            ok = false;
+        }
+        lines += count_lines(content);
+    }
+    if(lines != 2000){
+        std::cerr << "log_test_mmap failed: lines=" << lines << std::endl;
+        ok = false;
+    }
+    fs::remove_all(dir);
+
+    // 目录被删除后无法建新段: 丢弃并计数, 目录恢复后重试成功
+    fs::create_directories(dir);
+    {
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "mmap");
+        auto appender = std::make_shared<MmapFileAppender>(base, 4096);
+        logger->addAppender(appender);
+        LOG_INFO(logger) << "before remove";
+        fs::remove_all(dir);
+        for(int i=0; i<1000; ++i){
+            LOG_INFO(logger) << "mmap lost line " << i;
+        }
+        LogMetrics::AppenderStats stats;
+        appender->collectMetrics(stats);
+        if(appender->getDropped() == 0 || stats.dropped != appender->getDropped()){
+            ok = false;
+        }
+        fs::create_directories(dir);
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        LOG_INFO(logger) << "mmap recovered";
+        logger->clearAppender();
+    }
+    std::string recovered;
+    for(auto& entry : fs::directory_iterator(dir)){
+        recovered += read_file(entry.path().string());
+    }
+    if(recovered.find("mmap recovered") == std::string::npos || recovered.find('\0') != std::string::npos){
+        std::cerr << "log_test_mmap failed: not recovered" << std::endl;
+        ok = false;
+    }
+    fs::remove_all(dir);
+    if(!ok){
+        std::cerr << "log_test_mmap failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_binary(){
+    namespace fs = std::filesystem;
+    std::string path = (fs::temp_directory_path() / ("log4cpp_binary_" + std::to_string(::getpid()) + ".bin")).string();
+    fs::remove(path);
+    bool ok = true;
+
+    // 有文本输出器时在分发前渲染
+    auto text_logger = std::make_shared<Logger>(LogLevel::Level::debug, "text");
+    auto capture = std::make_shared<CaptureLogAppender>();
+    text_logger->addAppender(capture);
+    std::string name = "abc";
+    LOG4CPP_BIN_INFO(text_logger, "int {} double {} str {} {{}} char {}", -42, 2.5, name, 'x');
+    if(capture->getLast() != "int -42 double 2.5 str abc {} char x"){
+        std::cerr << "log_test_binary failed: " << capture->getLast() << std::endl;
+        ok = false;
+    }
+
+    {
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "bin");
+        auto appender = std::make_shared<BinaryLogAppender>(path);
+        logger->addAppender(appender);
+        for(int i=0; i<3; ++i){
+            LOG4CPP_BIN_WARN(logger, "value {} flag {}", i, i == 1);
+        }
+        LOG_ERROR(logger) << "text line";
+        appender->flush();
+        // 重新打开后字典重写, 追加的部分仍可独立解码
+        appender->reopen();
+        LOG4CPP_BIN_WARN(logger, "after reopen {}", 7u);
+        // 线程信息只在线程字典中出现一次
+        std::thread([&logger]{
+            setThreadName("binworker");
+            LOG4CPP_BIN_WARN(logger, "from {}", "worker");
+            LOG4CPP_BIN_WARN(logger, "from {}", "worker");
+        }).join();
+        logger->clearAppender();
+    }
+
+    std::ostringstream out;
+    BinaryLogDecoder decoder(std::make_shared<LogFormatter>("[%p] [%c] %m%n"));
+    if(!decoder.decodeFile(path, out)){
+        std::cerr << "log_test_binary failed: " << decoder.getError() << std::endl;
+        ok = false;
+    }
+    std::string expected = "[warn] [bin] value 0 flag 0\n"
+                           "[warn] [bin] value 1 flag 1\n"
+                           "[warn] [bin] value 2 flag 0\n"
+                           "[error] [bin] text line\n"
+                           "[warn] [bin] after reopen 7\n"
+                           "[warn] [bin] from worker\n"
+                           "[warn] [bin] from worker\n";
+    if(out.str() != expected){
+        std::cerr << "log_test_binary failed:\n" << out.str() << std::endl;
+        ok = false;
+    }
+    std::ostringstream threads;
+    BinaryLogDecoder thread_decoder(std::make_shared<LogFormatter>("%N|%m%n"));
+    thread_decoder.decodeFile(path, threads);
+    std::string data = read_file(path);
+    if(threads.str().find("binworker|from worker\nbinworker|from worker\n") == std::string::npos
+            || data.find("binworker") != data.rfind("binworker")){
+        std::cerr << "log_test_binary failed: thread dictionary\n" << threads.str() << std::endl;
+        ok = false;
+    }
+    fs::remove(path);
+    return ok;
+}
+
+bool log_test_crash(){
+    namespace fs = std::filesystem;
+    std::string path = (fs::temp_directory_path() / ("log4cpp_crash_" + std::to_string(::getpid()) + ".log")).string();
+    fs::remove(path);
+    bool ok = true;
+
+    // 子进程只缓冲不写出, abort 后缓冲由崩溃处理写出
+    pid_t pid = ::fork();
+    if(pid == 0){
+        rlimit limit{0, 0};
+        ::setrlimit(RLIMIT_CORE, &limit);
+        ::dup2(::open("/dev/null", O_WRONLY), STDERR_FILENO);
+        CrashHandler::Install();
+        FileLogAppender::FlushPolicy policy;
+        policy.bytes = 1 << 20;
+        policy.interval = std::chrono::milliseconds(-1);
+        policy.level = LogLevel::Level::fatal;
+        auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "crash");
+        logger->addAppender(std::make_shared<FileLogAppender>(path, policy));
+        LOG_ERROR(logger) << "before crash";
+        std::abort();
+    }
+    int status = 0;
+    ::waitpid(pid, &status, 0);
+    if(!WIFSIGNALED(status) || WTERMSIG(status) != SIGABRT || read_file(path).find("before crash") == std::string::npos){
+        std::cerr << "log_test_crash failed: status " << status << " content \"" << read_file(path) << "\"" << std::endl;
+        ok = false;
+    }
+    fs::remove(path);
+
+    // fatal 事件返回前异步队列已写出
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "fatal");
+    auto counter = std::make_shared<CountLogAppender>();
+    counter->setDelay(std::chrono::milliseconds(20));
+    logger->addAppender(std::make_shared<AsyncLogAppender>(counter));
+    LOG_FATAL(logger) << "fatal";
+    if(counter->getCount() != 1){
+        std::cerr << "log_test_crash failed: fatal event not flushed" << std::endl;
+        ok = false;
+    }
+    return ok;
+}
+
+bool log_test_socket(){
+    // 本地监听端代替日志收集端
+    namespace fs = std::filesystem;
+    bool ok = true;
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "net.socket");
+    auto wait_readable = [](int fd){
+        pollfd pfd{fd, POLLIN, 0};
+        return ::poll(&pfd, 1, 2000) > 0;
+    };
+
+    // Unix 数据报, 每条记录一个 RFC 5424 报文
+    std::string path = (fs::temp_directory_path() / ("log4cpp_socket_" + std::to_string(::getpid()))).string();
+    ::unlink(path.c_str());
+    int server = ::socket(AF_UNIX, SOCK_DGRAM, 0);
+    sockaddr_un un{};
+    un.sun_family = AF_UNIX;
+    std::strncpy(un.sun_path, path.c_str(), sizeof(un.sun_path) - 1);
+    ok = ::bind(server, reinterpret_cast<sockaddr*>(&un), sizeof(un)) == 0;
+    {
+        SocketLogAppender::Options options;
+        options.address = path;
+        options.app_name = "tests";
+        auto appender = std::make_shared<SocketLogAppender>(options);
+        logger->addAppender(appender);
+        LOG_INFO(logger) << "hello " << 1;
+        LOG_WARN(logger) << "hello " << 2;
+        appender->flush();
+        logger->clearAppender();
+    }
+    for(int i=1; i<=2 && ok; ++i){
+        char buf[1024];
+        ssize_t n = wait_readable(server) ? ::recv(server, buf, sizeof(buf), 0) : -1;
+        std::string msg(buf, n > 0 ? n : 0);
+        ok = msg.rfind(i == 1 ? "<14>1 " : "<12>1 ", 0) == 0
+            && msg.ends_with(" tests " + std::to_string(::getpid()) + " net.socket - hello " + std::to_string(i));
+    }
+    ::close(server);
+    ::unlink(path.c_str());
+
+    // TCP: 对端不可用时暂存到上限, 对端上线后重连并按序补发
+    int listener = ::socket(AF_INET, SOCK_STREAM, 0);
+    int on = 1;
+    ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+    sockaddr_in in{};
+    in.sin_family = AF_INET;
+    in.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(in);
+    ::bind(listener, reinterpret_cast<sockaddr*>(&in), sizeof(in));
+    ::getsockname(listener, reinterpret_cast<sockaddr*>(&in), &len);
+    ::close(listener);
+    {
+        SocketLogAppender::Options options;
+        options.protocol = SocketLogAppender::Protocol::tcp;
+        options.address = "127.0.0.1";
+        options.port = ntohs(in.sin_port);
+        options.syslog = false;
+        options.spill_bytes = 256;
+        options.reconnect_min = std::chrono::milliseconds(10);
+        options.reconnect_max = std::chrono::milliseconds(20);
+        auto appender = std::make_shared<SocketLogAppender>(options);
+        appender->setFormatter(std::make_shared<LogFormatter>("%m%n"));
+        logger->addAppender(appender);
+        for(int i=0; i<50; ++i){
+            LOG_INFO(logger) << "line " << i;
+        }
+        appender->flush();
+        uint64_t kept = 50 - appender->getDropped();
+        ok = ok && !appender->isConnected() && kept > 0 && kept < 50;
+
+        listener = ::socket(AF_INET, SOCK_STREAM, 0);
+        ::setsockopt(listener, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        ok = ok && ::bind(listener, reinterpret_cast<sockaddr*>(&in), sizeof(in)) == 0 && ::listen(listener, 1) == 0;
+        int conn = ok && wait_readable(listener) ? ::accept(listener, nullptr, nullptr) : -1;
+        std::string expected;
+        for(uint64_t i=0; i<kept; ++i){
+            expected += "line " + std::to_string(i) + "\n";
+        }
+        std::string received;
+        char buf[1024];
+        while(conn >= 0 && received.size() < expected.size() && wait_readable(conn)){
+            ssize_t n = ::recv(conn, buf, sizeof(buf), 0);
+            if(n <= 0){
+                break;
+            }
+            received.append(buf, n);
+        }
+        ok = ok && received == expected;
+        logger->clearAppender();
+        appender.reset();
+        if(conn >= 0){
+            ::close(conn);
+        }
+        ::close(listener);
+    }
+    if(!ok){
+        std::cerr << "log_test_socket failed" << std::endl;
+    }
+    return ok;
+}
+
+bool log_test_config(){
+    namespace fs = std::filesystem;
+    fs::path dir = fs::temp_directory_path() / ("log4cpp_config_" + std::to_string(::getpid()));
+    fs::create_directories(dir);
+    std::string path = (dir / "log4cpp.ini").string();
+    std::string log_path = (dir / "app.log").string();
+    auto write = [&](const std::string& text){
+        // 以 rename 方式替换, 同编辑器保存
+        std::ofstream(path + ".tmp") << text;
+        fs::rename(path + ".tmp", path);
+    };
+    bool ok = true;
+    auto fail = [&](const std::string& what){
+        std::cerr << "log_test_config failed: " << what << std::endl;
+        ok = false;
+    };
+
+    write("[appender.app]\n"
+          "type = file   ; 行尾注释\n"
+          "file = " + log_path + "\n"
+          "pattern = %p %c %m%n\n"
+          "flush_bytes = 0\n"
+          "\n"
+          "[logger.cfg.db]\n"
+          "level = warn\n"
+          "additivity = false\n"
+          "appenders = app\n");
+    ConfigLoader loader(path);
+    auto logger = LoggerManager::getInstance().getLogger("cfg.db");
+    if(!loader.load() || logger->getLevel() != LogLevel::Level::warn || logger->getAdditivity()
+            || logger->getAppenders().size() != 1){
+        fail("initial load: " + loader.getError());
+    }
+    LOG_INFO(logger) << "filtered";
+    LOG_WARN(logger) << "written";
+    if(read_file(log_path) != "warn cfg.db written\n"){
+        fail("content \"" + read_file(log_path) + "\"");
+    }
+
+    // 出错的配置不生效
+    LogConfig config;
+    std::string error;
+    if(LogConfig::Parse("[logger.x]\nlevel = loud\n", config, error) || error.find("line 2") == std::string::npos){
+        fail("invalid level accepted: " + error);
+    }
+    std::string other_path = (dir / "other.log").string();
+    uint64_t threads = g_threads_created.load();
+    for(const char* bad : {"[logger.cfg.db]\nappenders = other, missing\n",
+                           "[logger.cfg.db]\npattern = %d{\nappenders = other\n",
+                           "[logger.cfg.db]\nappenders = other\n[appender.typo]\ntype = file\nfile = x\nflush_bytez = 1\n",
+                           "[appender.console]\ntype = stdout\nasync = true\n[logger.cfg.db]\nappenders = console, missing\n"}){
+        write("[appender.other]\ntype = file\nfile = " + other_path + "\n" + bad);
+        if(loader.load() || logger->getLevel() != LogLevel::Level::warn){
+            fail("invalid config applied");
+        }
+    }
+    // 校验在创建输出器之前完成: 不打开文件, 也不启动线程
+    if(fs::exists(other_path) || g_threads_created.load() != threads){
+        fail("appender created for an invalid config");
+    }
+
+    // 节内容不变的输出器沿用原对象, 变化的重新创建; flush_interval 可为负数
+    std::string kept = "[appender.app]\ntype = file\nfile = " + log_path + "\npattern = %p %c %m%n\n"
+                       "flush_bytes = 0\nflush_interval = -1\n\n";
+    write(kept + "[logger.cfg.db]\nlevel = warn\nappenders = app\n");
+    auto first = loader.load() && logger->getAppenders().size() == 1 ? logger->getAppenders()[0] : nullptr;
+    write(kept + "[logger.cfg.db]\nlevel = error\nappenders = app\n");
+    auto second = loader.load() && logger->getAppenders().size() == 1 ? logger->getAppenders()[0] : nullptr;
+    if(!first || first != second || logger->getLevel() != LogLevel::Level::error){
+        fail("unchanged appender not reused: " + loader.getError());
+    }
+    write(kept + "async = true\n[logger.cfg.db]\nlevel = error\nappenders = app\n");
+    auto third = loader.load() && logger->getAppenders().size() == 1 ? logger->getAppenders()[0] : nullptr;
+    if(!third || third == second){
+        fail("changed appender reused: " + loader.getError());
+    }
+    write("[appender.net]\ntype = udp\naddress = 127.0.0.1\nflush_interval = -1\n");
+    if(loader.load()){
+        fail("negative socket flush_interval accepted");
+    }
+
+    // 文件变化后自动重新加载; 不再出现的日志器恢复默认
+    if(!loader.watch()){
+        fail("watch: " + loader.getError());
+    }
+    uint64_t generation = loader.getGeneration();
+    write("[logger.cfg.net]\nlevel = error\n");
+    for(int i=0; i<200 && loader.getGeneration() == generation; ++i){
+        std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    }
+    auto net = LoggerManager::getInstance().getLogger("cfg.net");
+    if(loader.getGeneration() == generation || net->getLevel() != LogLevel::Level::error
+            || logger->hasLevel() || !logger->getAdditivity() || !logger->getAppenders().empty()){
+        fail("reload");
+    }
+    loader.stop();
+    fs::remove_all(dir);
+    return ok;
+}
+
+bool log_test_alloc(){
+    auto logger = std::make_shared<Logger>(LogLevel::Level::debug, "alloc");
+    logger->addAppender(std::make_shared<NullLogAppender>());
+    auto emit = [&](int i){
+        LOG_INFO(logger) << "steady state " << i << " " << 3.5
+                         << " a message that is longer than the small string buffer";
+        LOG_FMT(logger, "warn", "fmt %d %s", i, "text");
+        LOG4CPP_ERROR(logger, "format {} {}", i, "text");
+        LOG_DEBUG(logger) << "debug " << i;
+    };
+    for(int i=0; i<1000; ++i){
+        emit(i);
+    }
+    t_allocs = 0;
+    t_count_allocs = true;
+    for(int i=0; i<10000; ++i){
+        emit(i);
+    }
+    t_count_allocs = false;
+    if(t_allocs != 0){
+        std::cerr << "log_test_alloc failed: " << t_allocs << " allocations" << std::endl;
+        return false;
+    }
+    return true;
+}
+
 int main(){
+    bool ok = true;
+    ok = log_test_crash() && ok;
+    ok = log_test_async() && ok;
+    ok = log_test_snapshot() && ok;
+    ok = log_test_registry() && ok;
+    ok = log_test_hierarchy() && ok;
+    ok = log_test_stdout() && ok;
+    ok = log_test_metrics() && ok;
+    ok = log_test_limited() && ok;
+    ok = log_test_format() && ok;
+    ok = log_test_formatter() && ok;
+    ok = log_test_datetime() && ok;
+    ok = log_test_thread() && ok;
+    ok = log_test_clock() && ok;
+    ok = log_test_json() && ok;
+    ok = log_test_file() && ok;
+    ok = log_test_fanout() && ok;
+    ok = log_test_rolling() && ok;
+    ok = log_test_mmap() && ok;
+    ok = log_test_binary() && ok;
+    ok = log_test_socket() && ok;
+    ok = log_test_config() && ok;
+    ok = log_test_alloc() && ok;
+
     auto start1 = std::chrono::high_resolution_clock::now();
     log_test_multithread();
     auto end1 = std::chrono::high_resolution_clock::now();
@@ -59,5 +1333,5 @@ int main(){
     // auto end2 = std::chrono::high_resolution_clock::now();
     // auto duration2 = std::chrono::duration_cast<std::chrono::duration<double>>(end2 - start2).count();
     // std::cout << "Time taken by log_test_parallel() function: " << duration2 << " s" << std::endl;
-    return 0;
+    return ok ? 0 : 1;
 }
\ No newline at end of file
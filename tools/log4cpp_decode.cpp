@@ -0,0 +1,26 @@
+#include "binary.hpp"
+
+#include <iostream>
+
+// 把 BinaryLogAppender 写出的二进制日志渲染成文本
+// 用法: log4cpp-decode <file> [pattern]
+int main(int argc, char** argv){
+    if(argc < 2){
+        std::cerr << "usage: " << argv[0] << " <file> [pattern]" << std::endl;
+        return 2;
+    }
+    std::string pattern = argc > 2 ? argv[2] : "%d{%Y-%m-%d %H:%M:%S}%T%t%T%N%T%F%T[%p]%T[%c]%T%f:%l%T%m%n";
+    auto formatter = std::make_shared<log4cpp::LogFormatter>(pattern);
+    if(formatter->isError()){
+        std::cerr << "invalid pattern: " << pattern << std::endl;
+        return 2;
+    }
+    log4cpp::BinaryLogDecoder decoder(formatter);
+    bool ok = decoder.decodeFile(argv[1], std::cout);
+    std::cout.flush();
+    if(!ok){
+        std::cerr << argv[1] << ": " << decoder.getError() << std::endl;
+        return 1;
+    }
+    return 0;
+}